@@ -0,0 +1,209 @@
+#ifndef ALLOC_TRACKING_H
+#define ALLOC_TRACKING_H
+#include <SDL.h>
+#include <climits>
+#include <cstdlib>
+#include <new>
+
+// Bump allocator for data that only lives until the end of the current frame.
+// The block is allocated once; allocate() just moves a pointer and reset()
+// throws everything away at once. Running out returns nullptr instead of
+// falling back to the heap.
+struct FrameArena {
+    Uint8* memory = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t highWater = 0;
+
+    void init(size_t bytes)
+    {
+        memory = static_cast<Uint8*>(SDL_malloc(bytes));
+        capacity = memory ? bytes : 0;
+        used = 0;
+        highWater = 0;
+        if (memory == nullptr) SDL_Log("Unable to allocate %u byte frame arena", static_cast<unsigned>(bytes));
+    }
+
+    void* allocate(size_t size, size_t align)
+    {
+        size_t start = (used + align - 1) & ~(align - 1);
+        if (start + size > capacity) return nullptr;
+        used = start + size;
+        if (used > highWater) highWater = used;
+        return memory + start;
+    }
+
+    template <typename T>
+    T* allocate(int count)
+    {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // How many Ts still fit.
+    template <typename T>
+    int room() const
+    {
+        size_t start = (used + alignof(T) - 1) & ~(alignof(T) - 1);
+        return start >= capacity ? 0 : static_cast<int>((capacity - start) / sizeof(T));
+    }
+
+    void reset()
+    {
+        used = 0;
+    }
+
+    void release()
+    {
+        SDL_free(memory);
+        memory = nullptr;
+        capacity = 0;
+        used = 0;
+    }
+};
+
+// Allocations made by this thread while a scope is active are counted
+// against it. A fatal scope aborts on the first one when the game is built
+// with ALLOCATION_GUARD, which is how the steady-state simulation tick proves
+// it never touches the heap.
+struct AllocationScope {
+    const char* name;
+    bool fatal;
+    SDL_atomic_t count;
+};
+
+thread_local AllocationScope* currentAllocationScope = nullptr;
+
+SDL_atomic_t newAllocations;
+SDL_atomic_t newBytes;
+SDL_atomic_t sdlAllocations;
+
+struct AllocationGuard {
+    AllocationScope* previous;
+
+    AllocationGuard(AllocationScope& scope)
+    {
+        previous = currentAllocationScope;
+        currentAllocationScope = &scope;
+    }
+    ~AllocationGuard()
+    {
+        currentAllocationScope = previous;
+    }
+};
+
+void noteAllocation()
+{
+    AllocationScope* scope = currentAllocationScope;
+    if (scope == nullptr) return;
+
+    SDL_AtomicAdd(&scope->count, 1);
+#ifdef ALLOCATION_GUARD
+    if (scope->fatal) {
+        currentAllocationScope = nullptr;
+        SDL_LogMessage(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_CRITICAL,
+                       "Heap allocation during %s", scope->name);
+        abort();
+    }
+#endif
+}
+
+// Adds to an int counter without wrapping; it sticks at INT_MAX instead.
+void addSaturated(SDL_atomic_t* counter, size_t amount)
+{
+    int old, added;
+    do {
+        old = SDL_AtomicGet(counter);
+        added = amount >= static_cast<size_t>(INT_MAX - old) ? INT_MAX : old + static_cast<int>(amount);
+    } while (!SDL_AtomicCAS(counter, old, added));
+}
+
+void* operator new(size_t size)
+{
+    SDL_AtomicAdd(&newAllocations, 1);
+    addSaturated(&newBytes, size);
+    noteAllocation();
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+SDL_malloc_func realSdlMalloc = nullptr;
+SDL_calloc_func realSdlCalloc = nullptr;
+SDL_realloc_func realSdlRealloc = nullptr;
+SDL_free_func realSdlFree = nullptr;
+
+void* SDLCALL countingSdlMalloc(size_t size)
+{
+    SDL_AtomicAdd(&sdlAllocations, 1);
+    noteAllocation();
+    return realSdlMalloc(size);
+}
+
+void* SDLCALL countingSdlCalloc(size_t count, size_t size)
+{
+    SDL_AtomicAdd(&sdlAllocations, 1);
+    noteAllocation();
+    return realSdlCalloc(count, size);
+}
+
+void* SDLCALL countingSdlRealloc(void* p, size_t size)
+{
+    SDL_AtomicAdd(&sdlAllocations, 1);
+    noteAllocation();
+    return realSdlRealloc(p, size);
+}
+
+void SDLCALL countingSdlFree(void* p)
+{
+    realSdlFree(p);
+}
+
+// Routes SDL_malloc and friends (SDL itself, and SDL_image/ttf/mixer where
+// they use them) through the counters. Must run before SDL allocates
+// anything, so before SDL_Init.
+void installAllocationHooks()
+{
+    SDL_GetMemoryFunctions(&realSdlMalloc, &realSdlCalloc, &realSdlRealloc, &realSdlFree);
+    if (SDL_SetMemoryFunctions(countingSdlMalloc, countingSdlCalloc, countingSdlRealloc, countingSdlFree) != 0) {
+        SDL_Log("Unable to hook SDL memory functions: %s", SDL_GetError());
+    }
+}
+
+// Logs heap activity since the previous call, plus the per-scope counts.
+void logAllocations(const char* phase, AllocationScope& tickScope, AllocationScope& frameScope)
+{
+    int allocations = SDL_AtomicSet(&newAllocations, 0);
+    int bytes = SDL_AtomicSet(&newBytes, 0);
+    int sdl = SDL_AtomicSet(&sdlAllocations, 0);
+    int ticks = SDL_AtomicSet(&tickScope.count, 0);
+    int frames = SDL_AtomicSet(&frameScope.count, 0);
+    SDL_Log("%s allocations: %d new (%s%d bytes), %d SDL_malloc, %d inside %s, %d inside %s",
+            phase, allocations, bytes == INT_MAX ? "over " : "", bytes, sdl, ticks, tickScope.name, frames, frameScope.name);
+}
+
+#endif
@@ -52,6 +52,18 @@ struct Audio {
         }
     }
 
+    void pause() {
+        if (!audioInitialized) return;
+        Mix_PauseMusic();
+        Mix_Pause(-1);
+    }
+
+    void resume() {
+        if (!audioInitialized) return;
+        Mix_ResumeMusic();
+        Mix_Resume(-1);
+    }
+
     void cleanUp() {
         if (!audioInitialized) return;
 
@@ -0,0 +1,73 @@
+#ifndef _CHUNKS_H
+#define _CHUNKS_H
+#include <SDL.h>
+
+const int MAX_CHUNK_OBSTACLES = 8;
+const int CHUNK_QUEUE_SIZE = 4;
+const int MAX_SPEED_MARKS = 8;
+
+struct ChunkObstacle {
+    int type;
+    int offsetX;
+};
+
+// A run of obstacles laid out relative to the chunk origin. The chunk is only
+// valid at its own speed, which takes over once the origin reaches the rabbit.
+struct ObstacleChunk {
+    int index = 0;
+    int speed = 0;
+    int length = 0;
+    int count = 0;
+    ChunkObstacle obstacles[MAX_CHUNK_OBSTACLES];
+};
+
+// Single producer / single consumer ring. The generator thread fills slots in
+// place and the game thread reads them in place, so a chunk is never copied on
+// its way across. Only the consumer side is used from the game thread and it
+// never blocks: an empty queue just means "no chunk this tick".
+struct ChunkQueue {
+    ObstacleChunk slots[CHUNK_QUEUE_SIZE];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_sem* freeSlots = nullptr;
+
+    void init()
+    {
+        SDL_AtomicSet(&head, 0);
+        SDL_AtomicSet(&tail, 0);
+        freeSlots = SDL_CreateSemaphore(CHUNK_QUEUE_SIZE);
+    }
+
+    void destroy()
+    {
+        if (freeSlots) {
+            SDL_DestroySemaphore(freeSlots);
+            freeSlots = nullptr;
+        }
+    }
+
+    ObstacleChunk& writeSlot()
+    {
+        return slots[SDL_AtomicGet(&tail) % CHUNK_QUEUE_SIZE];
+    }
+
+    void push()
+    {
+        SDL_AtomicAdd(&tail, 1);
+    }
+
+    const ObstacleChunk* peek()
+    {
+        int current = SDL_AtomicGet(&head);
+        if (current == SDL_AtomicGet(&tail)) return nullptr;
+        return &slots[current % CHUNK_QUEUE_SIZE];
+    }
+
+    void pop()
+    {
+        SDL_AtomicAdd(&head, 1);
+        SDL_SemPost(freeSlots);
+    }
+};
+
+#endif
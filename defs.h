@@ -16,11 +16,17 @@ const char* NOTIFICATION_BOARD_IMG = "notificationBoard.png";
 const char* BGM_PATH = "backgroundMusic.mp3";
 const char* WIN_SOUND_PATH = "gameWinSound.wav";
 const char* LOSE_SOUND_PATH = "gameLoseSound.wav";
+const char* SAVE_FILE = "savegame.dat";
 
 const int redBirdTickDelay = 100;
 const int rabbitTickDelay = 90;
 const int OBSTACLE_SPAWN_INTERVAL = 4000;
 const int OBSTACLE_SPEED = 4;
+const int SIMULATION_TICK_MS = 16;
+const int RENDER_FRAME_MS = 16;
+const int MAX_CATCHUP_TICKS = 8;
+const int IDLE_WAIT_TIMEOUT_MS = 5000;
+const int INPUT_GRACE_MS = 250;
 
 
 const char*  RED_BIRD_SPRITE_FILE = "redbird.png";
@@ -55,12 +61,17 @@ const int RABBIT_CLIPS[][4] = {
 };
 const int RABBIT_FRAMES = sizeof(RABBIT_CLIPS)/sizeof(int)/4;
 
+const int OBSTACLE_ROCK = 0;
+const int OBSTACLE_MUSHROOM = 1;
+const int OBSTACLE_GRASS = 2;
+const int OBSTACLE_KINDS = 3;
+
 struct Obstacle {
     SDL_Texture* texture;
     int x, y;
     int width, height;
     int radius;
-    std::string type;
+    int kind;
     bool passed = false;
 };
 
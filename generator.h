@@ -0,0 +1,199 @@
+#ifndef _GENERATOR_H
+#define _GENERATOR_H
+#include <SDL.h>
+#include <algorithm>
+#include "defs.h"
+#include "logic.h"
+#include "chunks.h"
+#include "random.h"
+
+const int MAX_OBSTACLE_SPEED = 10;
+const int CHUNKS_PER_LEVEL = 3;
+const int MAX_ARC_TICKS = 256;
+const int CHUNK_ATTEMPTS = 16;
+
+// Builds endless-mode chunks ahead of the player on a background thread and
+// only hands over chunks the rabbit can actually get through.
+struct ChunkGenerator {
+    ChunkQueue queue;
+    Random random;
+    SDL_Thread* thread = nullptr;
+    SDL_atomic_t running;
+    Uint32 seed = 0;
+    int chunkIndex = 0;
+
+    // Rabbit heights after each tick of a jump, produced with the same
+    // integration as updateRabbit(). The last entry is the landing tick.
+    float arcY[MAX_ARC_TICKS];
+    int arcLength = 0;
+
+    void start(Uint32 _seed, int firstIndex = 0)
+    {
+        seed = _seed;
+        chunkIndex = firstIndex;
+        buildJumpArc();
+        queue.init();
+
+        // One chunk up front, so the game never finds a fresh queue empty.
+        SDL_SemWait(queue.freeSlots);
+        generate(queue.writeSlot());
+        queue.push();
+
+        SDL_AtomicSet(&running, 1);
+        thread = SDL_CreateThread(run, "chunk generator", this);
+        if (thread == nullptr) {
+            SDL_Log("Unable to start chunk generator: %s", SDL_GetError());
+        }
+    }
+
+    void stop()
+    {
+        SDL_AtomicSet(&running, 0);
+        if (thread) {
+            SDL_SemPost(queue.freeSlots);
+            SDL_WaitThread(thread, NULL);
+            thread = nullptr;
+        }
+        queue.destroy();
+    }
+
+    // Rewinding or loading moves the game to another point of the sequence;
+    // whatever is queued belongs to the old one.
+    void restart(Uint32 _seed, int firstIndex)
+    {
+        stop();
+        start(_seed, firstIndex);
+    }
+
+    static int run(void* data)
+    {
+        ChunkGenerator* generator = static_cast<ChunkGenerator*>(data);
+        while (SDL_AtomicGet(&generator->running)) {
+            if (SDL_SemWaitTimeout(generator->queue.freeSlots, 100) != 0) continue;
+            if (!SDL_AtomicGet(&generator->running)) break;
+
+            generator->generate(generator->queue.writeSlot());
+            generator->queue.push();
+        }
+        return 0;
+    }
+
+    void buildJumpArc()
+    {
+        float y = groundY;
+        float v = jumpStrength;
+        arcLength = 0;
+        while (arcLength < MAX_ARC_TICKS) {
+            bool landed = stepRabbit(y, v);
+            arcY[arcLength++] = y;
+            if (landed) break;
+        }
+    }
+
+    void generate(ObstacleChunk& chunk)
+    {
+        int level = chunkIndex / CHUNKS_PER_LEVEL;
+        chunk.index = chunkIndex++;
+        // Each chunk gets its own stream, so chunk n comes out the same
+        // however often it is generated.
+        random.seed(seed ^ (static_cast<Uint32>(chunk.index) * 0x9E3779B9u));
+        chunk.speed = std::min(OBSTACLE_SPEED + level / 2, MAX_OBSTACLE_SPEED);
+
+        int maxClusterSize = std::min(1 + level / 2, 3);
+        int maxClusters = std::min(1 + level / 2, 4);
+        int maxGap = std::max(650 - level * 50, 200);
+
+        for (int attempt = 0; attempt < CHUNK_ATTEMPTS; attempt++) {
+            // Each failed attempt loosens the layout a little more.
+            int gapBonus = attempt * 40;
+            int clusters = 1 + random.range(maxClusters);
+            int x = random.between(0, 120) + gapBonus;
+            chunk.count = 0;
+
+            for (int c = 0; c < clusters && chunk.count < MAX_CHUNK_OBSTACLES; c++) {
+                int clusterSize = 1 + random.range(maxClusterSize);
+                for (int i = 0; i < clusterSize && chunk.count < MAX_CHUNK_OBSTACLES; i++) {
+                    int type = random.range(OBSTACLE_KINDS);
+                    chunk.obstacles[chunk.count++] = { type, x };
+                    x += (type == OBSTACLE_MUSHROOM ? 120 : 140) + random.between(0, 30);
+                }
+                x += random.between(150, maxGap) + gapBonus;
+            }
+            chunk.length = x + 250;
+
+            if (isJumpable(chunk)) return;
+        }
+
+        // Nothing random fitted: fall back to a single, widely spaced rock.
+        chunk.count = 1;
+        chunk.obstacles[0] = { OBSTACLE_ROCK, 400 };
+        chunk.length = 1000;
+    }
+
+    // Steps the chunk tick by tick from the moment its origin reaches the
+    // rabbit's front edge, tracking every jump phase the rabbit could be in.
+    // The chunk is jumpable if some sequence of jumps avoids every obstacle
+    // and leaves the rabbit on the ground when the chunk ends.
+    bool isJumpable(const ObstacleChunk& chunk) const
+    {
+        Obstacle obs[MAX_CHUNK_OBSTACLES];
+        for (int i = 0; i < chunk.count; i++) {
+            obs[i].texture = nullptr;
+            obs[i].y = groundY + 50;
+            setObstacleShape(obs[i], chunk.obstacles[i].type);
+        }
+
+        bool reachable[MAX_ARC_TICKS];
+        bool next[MAX_ARC_TICKS];
+        std::fill(reachable, reachable + arcLength, false);
+        reachable[0] = true;
+
+        const int originX = rabbitX + rabbitColliderW;
+        int ticks = (chunk.length + chunk.speed - 1) / chunk.speed;
+
+        for (int t = 1; t <= ticks; t++) {
+            for (int i = 0; i < chunk.count; i++) {
+                obs[i].x = originX + chunk.obstacles[i].offsetX - t * chunk.speed;
+            }
+
+            std::fill(next, next + arcLength, false);
+            bool any = false;
+            for (int phase = 0; phase < arcLength; phase++) {
+                if (!reachable[phase]) continue;
+                if (phase == 0) {
+                    any |= tryPhase(next, 0, 0, obs, chunk);
+                    any |= tryPhase(next, 0, 1, obs, chunk);
+                } else {
+                    any |= tryPhase(next, phase, phase + 1 == arcLength ? 0 : phase + 1, obs, chunk);
+                }
+            }
+            if (!any) return false;
+            std::copy(next, next + arcLength, reachable);
+        }
+        return reachable[0];
+    }
+
+    float phaseY(int phase) const
+    {
+        return (phase == 0) ? groundY : arcY[phase - 1];
+    }
+
+    // Sweeps one tick of the arc the way ObstacleManager::update() sweeps each
+    // tick of a step, so a chunk passes here exactly when the game would let
+    // the rabbit through it.
+    bool tryPhase(bool* next, int from, int phase, const Obstacle* obs, const ObstacleChunk& chunk) const
+    {
+        if (next[phase]) return true;
+
+        SDL_Rect rabbitRect = getRabbitCollider(phaseY(phase));
+        SDL_Rect rabbitFrom = getRabbitCollider(phaseY(from));
+        rabbitFrom.x -= chunk.speed;
+        for (int i = 0; i < chunk.count; i++) {
+            if (checkSweptCollisionByType(rabbitFrom, rabbitRect, obs[i])) return false;
+        }
+        next[phase] = true;
+        return true;
+    }
+};
+
+#endif
@@ -5,8 +5,37 @@
 #include <SDL_image.h>
 #include <SDL_ttf.h>
 #include <vector>
+#include <algorithm>
 #include "defs.h"
 
+// Window scales the pre-scaled texture variants are generated for.
+const float WINDOW_SCALES[] = { 0.5f, 0.75f, 1.0f, 1.5f };
+const int WINDOW_SCALE_COUNT = sizeof(WINDOW_SCALES) / sizeof(float);
+
+const int TEXT_CACHE_SIZE = 8;
+const int TEXT_MESSAGE_BYTES = 64;
+
+// Smaller copies of one texture, rendered once at load time so that drawing it
+// small does not sample the full-size image every frame. Sorted by size,
+// smallest first; the source texture itself is always the fallback.
+struct TextureVariants {
+    SDL_Texture* source;
+    int sourceWidth, sourceHeight;
+    int count = 0;
+    SDL_Texture* textures[WINDOW_SCALE_COUNT];
+    int widths[WINDOW_SCALE_COUNT];
+    int heights[WINDOW_SCALE_COUNT];
+};
+
+// A message already rendered by renderText, so drawing the same board text
+// every frame does not go through TTF and a new texture each time.
+struct TextTexture {
+    char message[TEXT_MESSAGE_BYTES];
+    int maxWidth;
+    SDL_Texture* texture;
+    int width, height;
+};
+
 struct ScrollingBackground {
     SDL_Texture* texture;
     int scrollingOffset = 0;
@@ -39,6 +68,7 @@ struct Sprite {
     void init(SDL_Texture* _texture, int frames, const int _clips [][4])
     {
         texture = _texture;
+        clips.reserve(frames);
 
         SDL_Rect clip;
         for (int i = 0; i < frames; i++) {
@@ -58,6 +88,11 @@ struct Sprite {
     {
         return &(clips[currentFrame]);
     }
+
+    const SDL_Rect* getClip(int frame) const
+    {
+        return &(clips[frame]);
+    }
      void reset()
     {
         currentFrame = 0;
@@ -68,6 +103,11 @@ struct Graphics {
     SDL_Renderer *renderer;
 	SDL_Window *window;
     TTF_Font* font = nullptr;
+    std::vector<TextureVariants> variants;
+    float outputScale = 1.0f;
+    bool vsync = false;
+    TextTexture texts[TEXT_CACHE_SIZE];
+    int textCount = 0;
 
 	void logErrorAndExit(const char* msg, const char* error)
     {
@@ -81,9 +121,12 @@ struct Graphics {
         if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
             logErrorAndExit("SDL_Init", SDL_GetError());
 
-        window = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+        window = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 
         if (window == nullptr) logErrorAndExit("CreateWindow", SDL_GetError());
+        // The smallest of the WINDOW_SCALES; below it nothing is pre-scaled.
+        SDL_SetWindowMinimumSize(window, static_cast<int>(SCREEN_WIDTH * WINDOW_SCALES[0]),
+                                 static_cast<int>(SCREEN_HEIGHT * WINDOW_SCALES[0]));
 
         if (!IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG))
             logErrorAndExit( "SDL_image error:", IMG_GetError());
@@ -95,6 +138,12 @@ struct Graphics {
 
         SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
         SDL_RenderSetLogicalSize(renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        updateOutputScale();
+
+        SDL_RendererInfo info;
+        vsync = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+        if (!vsync) SDL_Log("No vsync, pacing frames to the display refresh rate");
 
         if (TTF_Init() == -1) {
         logErrorAndExit("TTF_Init", TTF_GetError());
@@ -105,6 +154,141 @@ struct Graphics {
         }
     }
 
+    // How long the render loop should hold each frame itself: nothing when
+    // present already waits for vsync, otherwise one display refresh.
+    Uint32 frameInterval() const
+    {
+        if (vsync) return 0;
+        SDL_DisplayMode mode;
+        if (SDL_GetWindowDisplayMode(window, &mode) != 0 || mode.refresh_rate <= 0) return RENDER_FRAME_MS;
+        return 1000 / mode.refresh_rate;
+    }
+
+    // How many output pixels one logical pixel covers, following the
+    // letterboxing done by SDL_RenderSetLogicalSize.
+    void updateOutputScale()
+    {
+        int outputW, outputH;
+        if (SDL_GetRendererOutputSize(renderer, &outputW, &outputH) != 0) return;
+        outputScale = std::min(static_cast<float>(outputW) / SCREEN_WIDTH,
+                               static_cast<float>(outputH) / SCREEN_HEIGHT);
+    }
+
+    // Pre-scales texture for being drawn at drawWidth x drawHeight logical
+    // pixels, at each of the WINDOW_SCALES. Sizes that would not be smaller
+    // than the source are skipped.
+    void createVariants(SDL_Texture* texture, int drawWidth, int drawHeight)
+    {
+        if (texture == nullptr || !SDL_RenderTargetSupported(renderer)) return;
+
+        TextureVariants entry;
+        entry.source = texture;
+        SDL_QueryTexture(texture, NULL, NULL, &entry.sourceWidth, &entry.sourceHeight);
+
+        for (int i = 0; i < WINDOW_SCALE_COUNT; i++) {
+            int w = static_cast<int>(drawWidth * WINDOW_SCALES[i] + 0.5f);
+            int h = static_cast<int>(drawHeight * WINDOW_SCALES[i] + 0.5f);
+            if (w <= 0 || h <= 0 || w >= entry.sourceWidth || h >= entry.sourceHeight) continue;
+            if (entry.count > 0 && entry.widths[entry.count - 1] == w) continue;
+
+            SDL_Texture* scaled = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, w, h);
+            if (scaled == nullptr) {
+                SDL_Log("Unable to create texture variant! SDL Error: %s", SDL_GetError());
+                continue;
+            }
+            SDL_SetTextureBlendMode(scaled, SDL_BLENDMODE_BLEND);
+            entry.textures[entry.count] = scaled;
+            entry.widths[entry.count] = w;
+            entry.heights[entry.count] = h;
+            entry.count++;
+        }
+        if (entry.count == 0) return;
+
+        fillVariants(entry);
+        variants.push_back(entry);
+    }
+
+    void createVariants(SDL_Texture* texture)
+    {
+        int w, h;
+        if (texture == nullptr || SDL_QueryTexture(texture, NULL, NULL, &w, &h) != 0) return;
+        createVariants(texture, w, h);
+    }
+
+    // Render target contents are lost when some drivers reset the device.
+    void refreshVariants()
+    {
+        for (auto& entry : variants) fillVariants(entry);
+    }
+
+    // Draws each variant from the next larger one, largest first, so no step
+    // shrinks by much more than half and bilinear filtering stays clean.
+    void fillVariants(const TextureVariants& entry)
+    {
+        SDL_Texture* previousTarget = SDL_GetRenderTarget(renderer);
+        SDL_Texture* from = entry.source;
+        for (int i = entry.count - 1; i >= 0; i--) {
+            SDL_BlendMode mode;
+            SDL_GetTextureBlendMode(from, &mode);
+            SDL_SetTextureBlendMode(from, SDL_BLENDMODE_NONE);
+
+            SDL_SetRenderTarget(renderer, entry.textures[i]);
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, from, NULL, NULL);
+
+            SDL_SetTextureBlendMode(from, mode);
+            from = entry.textures[i];
+        }
+        SDL_SetRenderTarget(renderer, previousTarget);
+    }
+
+    const TextureVariants* findVariants(SDL_Texture* texture) const
+    {
+        for (const auto& entry : variants) {
+            if (entry.source == texture) return &entry;
+        }
+        return nullptr;
+    }
+
+    // Draws texture (or the clip of it) into dest using the smallest variant
+    // that still covers the on-screen size, so nothing is scaled up.
+    void renderScaled(SDL_Texture* texture, const SDL_Rect* clip, const SDL_Rect* dest)
+    {
+        const TextureVariants* entry = findVariants(texture);
+        if (entry == nullptr) {
+            SDL_RenderCopy(renderer, texture, clip, dest);
+            return;
+        }
+
+        float neededW = dest->w * outputScale;
+        float neededH = dest->h * outputScale;
+        if (clip) {
+            neededW *= static_cast<float>(entry->sourceWidth) / clip->w;
+            neededH *= static_cast<float>(entry->sourceHeight) / clip->h;
+        }
+
+        for (int i = 0; i < entry->count; i++) {
+            if (entry->widths[i] + 0.5f < neededW || entry->heights[i] + 0.5f < neededH) continue;
+
+            if (clip == nullptr) {
+                SDL_RenderCopy(renderer, entry->textures[i], NULL, dest);
+                return;
+            }
+            float scaleX = static_cast<float>(entry->widths[i]) / entry->sourceWidth;
+            float scaleY = static_cast<float>(entry->heights[i]) / entry->sourceHeight;
+            SDL_Rect scaled = {
+                static_cast<int>(clip->x * scaleX + 0.5f),
+                static_cast<int>(clip->y * scaleY + 0.5f),
+                static_cast<int>(clip->w * scaleX + 0.5f),
+                static_cast<int>(clip->h * scaleY + 0.5f)
+            };
+            SDL_RenderCopy(renderer, entry->textures[i], &scaled, dest);
+            return;
+        }
+        SDL_RenderCopy(renderer, texture, clip, dest);
+    }
+
     void prepareScene()
     {
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
@@ -179,6 +363,14 @@ struct Graphics {
             font = nullptr;
         }
 
+        for (auto& entry : variants) {
+            for (int i = 0; i < entry.count; i++) SDL_DestroyTexture(entry.textures[i]);
+        }
+        variants.clear();
+
+        for (int i = 0; i < textCount; i++) SDL_DestroyTexture(texts[i].texture);
+        textCount = 0;
+
         TTF_Quit();
         IMG_Quit();
 
@@ -191,12 +383,24 @@ struct Graphics {
     {
         const SDL_Rect* clip = sprite.getCurrentClip();
         SDL_Rect renderQuad = {x, y, clip->w, clip->h};
-        SDL_RenderCopy(renderer, sprite.texture, clip, &renderQuad);
+        renderScaled(sprite.texture, clip, &renderQuad);
+    }
+    void render(int x, int y, const Sprite& sprite, int frame)
+    {
+        const SDL_Rect* clip = sprite.getClip(frame);
+        SDL_Rect renderQuad = {x, y, clip->w, clip->h};
+        renderScaled(sprite.texture, clip, &renderQuad);
     }
     void render(int x, int y, SDL_Texture* texture, int width, int height)
     {
         SDL_Rect dest = {x, y, width, height};
-        SDL_RenderCopy(renderer, texture, NULL, &dest);
+        renderScaled(texture, NULL, &dest);
+    }
+    void renderGeometry(SDL_Texture* texture, const SDL_Vertex* vertices, int vertexCount, const int* indices, int indexCount)
+    {
+        if (SDL_RenderGeometry(renderer, texture, vertices, vertexCount, indices, indexCount) != 0) {
+            SDL_Log("Unable to render geometry! SDL Error: %s", SDL_GetError());
+        }
     }
     void renderObstacle(float x, float y, float radius, SDL_Texture* texture)
     {
@@ -215,7 +419,7 @@ struct Graphics {
         int boardX = (SCREEN_WIDTH - boardWidth) / 2;
         int boardY = (SCREEN_HEIGHT - boardHeight) / 2;
         SDL_Rect dest = { boardX, boardY, boardWidth, boardHeight };
-        SDL_RenderCopy(renderer, notificationBoard, NULL, &dest);
+        renderScaled(notificationBoard, NULL, &dest);
         int textMaxWidth = boardWidth - 40;
         int textX = boardX + boardWidth / 2;
         int textY = boardY + boardHeight / 2;
@@ -228,31 +432,75 @@ struct Graphics {
         int boardX = (SCREEN_WIDTH - boardWidth) / 2;
         int boardY = (SCREEN_HEIGHT - boardHeight) / 2;
         SDL_Rect dest = { boardX, boardY, boardWidth, boardHeight };
-        SDL_RenderCopy(renderer, notificationBoard, NULL, &dest);
+        renderScaled(notificationBoard, NULL, &dest);
         int textMaxWidth = boardWidth - 40;
         int textX = boardX + boardWidth / 2;
         int textY = boardY + boardHeight / 2;
         renderText("Congratulations! You win!", textX, textY, textMaxWidth);
     }
 
-    void renderText(const std::string& message, int x, int y, int maxWidth)
+    // Messages shorter than TEXT_MESSAGE_BYTES are kept rendered in texts;
+    // longer ones are rendered again on every call.
+    void renderText(const char* message, int x, int y, int maxWidth)
     {
-        SDL_Color textColor = { 165, 104, 73, 255 };
-        SDL_Surface* textSurface = TTF_RenderText_Blended_Wrapped(font, message.c_str(), textColor, maxWidth);
-        if (textSurface != nullptr) {
-            SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-            SDL_Rect renderQuad = {
-            x - textSurface->w / 2,
-            y - textSurface->h / 2,
-            textSurface->w,
-            textSurface->h
+        if (SDL_strlen(message) < TEXT_MESSAGE_BYTES) {
+            const TextTexture* text = findText(message, maxWidth);
+            if (text) drawText(*text, x, y);
+            return;
+        }
+
+        TextTexture text;
+        if (!createText(message, maxWidth, text)) return;
+        drawText(text, x, y);
+        SDL_DestroyTexture(text.texture);
+    }
+
+    void drawText(const TextTexture& text, int x, int y)
+    {
+        SDL_Rect renderQuad = {
+            x - text.width / 2,
+            y - text.height / 2,
+            text.width,
+            text.height
         };
-        SDL_RenderCopy(renderer, textTexture, NULL, &renderQuad);
-        SDL_FreeSurface(textSurface);
-        SDL_DestroyTexture(textTexture);
-        } else {
+        SDL_RenderCopy(renderer, text.texture, NULL, &renderQuad);
+    }
+
+    bool createText(const char* message, int maxWidth, TextTexture& text)
+    {
+        SDL_Color textColor = { 165, 104, 73, 255 };
+        SDL_Surface* textSurface = TTF_RenderText_Blended_Wrapped(font, message, textColor, maxWidth);
+        if (textSurface == nullptr) {
             SDL_Log("Unable to render text surface! SDL_ttf Error: %s\n", TTF_GetError());
+            return false;
+        }
+        text.maxWidth = maxWidth;
+        text.texture = SDL_CreateTextureFromSurface(renderer, textSurface);
+        text.width = textSurface->w;
+        text.height = textSurface->h;
+        SDL_FreeSurface(textSurface);
+        return text.texture != nullptr;
+    }
+
+    // The message is copied into the entry, so callers may pass temporary
+    // buffers. When the cache is full the oldest entry goes.
+    const TextTexture* findText(const char* message, int maxWidth)
+    {
+        for (int i = 0; i < textCount; i++) {
+            if (texts[i].maxWidth == maxWidth && SDL_strcmp(texts[i].message, message) == 0) return &texts[i];
+        }
+
+        TextTexture entry;
+        if (!createText(message, maxWidth, entry)) return nullptr;
+        SDL_strlcpy(entry.message, message, TEXT_MESSAGE_BYTES);
+
+        if (textCount == TEXT_CACHE_SIZE) {
+            SDL_DestroyTexture(texts[0].texture);
+            std::copy(texts + 1, texts + textCount, texts);
+            textCount--;
         }
+        texts[textCount] = entry;
+        return &texts[textCount++];
     }
 
 };
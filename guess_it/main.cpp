@@ -1,27 +1,184 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
-int generateRandomNumber()
+const int MAX_TRACKED_GUESSES = 128;
+
+// xorshift64* - fast, seedable and cheap enough to call once per guess.
+struct FastRandom {
+    unsigned long long state;
+
+    void seed(unsigned long long value)
+    {
+        state = value ? value : 0x9E3779B97F4A7C15ULL;
+    }
+    unsigned long long next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+    // The span is computed unsigned so any low <= high works, including the
+    // full long long range, where it wraps to 0.
+    long long between(long long low, long long high)
+    {
+        unsigned long long span = (unsigned long long)high - (unsigned long long)low + 1;
+        unsigned long long offset = span ? next() % span : next();
+        return (long long)((unsigned long long)low + offset);
+    }
+};
+
+typedef long long (*GuessStrategy)(long long low, long long high, FastRandom& rng);
+
+long long binaryGuess(long long low, long long high, FastRandom&)
 {
-    srand(time(0));
-    return rand() % 100 + 1;
+    return low + (long long)(((unsigned long long)high - (unsigned long long)low) / 2);
 }
-int getPlayerGuess()
+long long randomGuess(long long low, long long high, FastRandom& rng)
+{
+    return rng.between(low, high);
+}
+
+// 1: too big, -1: too small, 0: correct.
+int compareGuess(long long guess, long long secretNumber)
+{
+    if (guess > secretNumber) return 1;
+    if (guess < secretNumber) return -1;
+    return 0;
+}
+
+// An adversarial host never fixes the secret. It answers so that the larger
+// part of the remaining range stays open, which forces the worst case.
+int adversarialAnswer(long long guess, long long low, long long high)
+{
+    if (low == high) return 0;
+    if ((unsigned long long)guess - (unsigned long long)low > (unsigned long long)high - (unsigned long long)guess) return 1;
+    if (guess == high) return 1;
+    return -1;
+}
+
+struct BatchOptions {
+    long long rounds = 1000000;
+    long long low = 1;
+    long long high = 100;
+    int threads = 0;
+    unsigned long long seed = 0;
+    GuessStrategy strategy = binaryGuess;
+    const char* strategyName = "binary";
+    bool adversarial = false;
+};
+
+struct BatchResult {
+    long long totalGuesses = 0;
+    long long maxGuesses = 0;
+    vector<long long> histogram = vector<long long>(MAX_TRACKED_GUESSES + 1, 0);
+};
+
+int playRound(const BatchOptions& options, FastRandom& rng)
+{
+    long long low = options.low;
+    long long high = options.high;
+    long long secretNumber = options.adversarial ? 0 : rng.between(low, high);
+    int guesses = 0;
+
+    while (true) {
+        long long guess = options.strategy(low, high, rng);
+        guesses++;
+        int answer = options.adversarial ? adversarialAnswer(guess, low, high)
+                                         : compareGuess(guess, secretNumber);
+        if (answer == 0) return guesses;
+        if (answer > 0) high = guess - 1;
+        else low = guess + 1;
+    }
+}
+
+// Counts stay in locals while the rounds run and go into result once at the
+// end, so workers do not keep writing to neighbouring BatchResults.
+void playRounds(const BatchOptions& options, long long rounds, unsigned long long seed, BatchResult& result)
 {
-    int guess;
-    cout << endl << "Enter your guess(1...100): ";
+    FastRandom rng;
+    rng.seed(seed);
+    long long totalGuesses = 0;
+    long long maxGuesses = 0;
+    long long histogram[MAX_TRACKED_GUESSES + 1] = {};
+    for (long long i = 0; i < rounds; i++) {
+        int guesses = playRound(options, rng);
+        totalGuesses += guesses;
+        if (guesses > maxGuesses) maxGuesses = guesses;
+        histogram[guesses < MAX_TRACKED_GUESSES ? guesses : MAX_TRACKED_GUESSES]++;
+    }
+    result.totalGuesses = totalGuesses;
+    result.maxGuesses = maxGuesses;
+    for (int i = 0; i <= MAX_TRACKED_GUESSES; i++) result.histogram[i] = histogram[i];
+}
+
+int runBatch(const BatchOptions& options)
+{
+    int threadCount = options.threads > 0 ? options.threads : (int)thread::hardware_concurrency();
+    if (threadCount <= 0) threadCount = 1;
+
+    vector<BatchResult> results(threadCount);
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+
+    for (int t = 0; t < threadCount; t++) {
+        long long rounds = options.rounds / threadCount + (t < options.rounds % threadCount ? 1 : 0);
+        unsigned long long seed = options.seed + 0x9E3779B97F4A7C15ULL * (t + 1);
+        workers.push_back(thread(playRounds, cref(options), rounds, seed, ref(results[t])));
+    }
+    for (auto& worker : workers) worker.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    BatchResult total;
+    for (const auto& result : results) {
+        total.totalGuesses += result.totalGuesses;
+        if (result.maxGuesses > total.maxGuesses) total.maxGuesses = result.maxGuesses;
+        for (int i = 0; i <= MAX_TRACKED_GUESSES; i++) total.histogram[i] += result.histogram[i];
+    }
+
+    cout << "Strategy: " << options.strategyName
+         << (options.adversarial ? " vs adversarial host" : "")
+         << ", range " << options.low << "..." << options.high
+         << ", " << threadCount << " thread(s)" << endl;
+    cout << "Rounds: " << options.rounds << " in " << seconds << " s ("
+         << (seconds > 0 ? options.rounds / seconds : 0) << " rounds/s)" << endl;
+    cout << "Guesses per round: mean " << (double)total.totalGuesses / options.rounds
+         << ", max " << total.maxGuesses << endl;
+    for (int i = 1; i <= MAX_TRACKED_GUESSES; i++) {
+        if (total.histogram[i] == 0) continue;
+        cout << (i == MAX_TRACKED_GUESSES ? ">=" : "  ") << i << ": " << total.histogram[i]
+             << " (" << 100.0 * total.histogram[i] / options.rounds << "%)" << endl;
+    }
+    return 0;
+}
+
+long long generateRandomNumber(FastRandom& rng, long long low, long long high)
+{
+    return rng.between(low, high);
+}
+long long getPlayerGuess(long long low, long long high)
+{
+    long long guess;
+    cout << endl << "Enter your guess(" << low << "..." << high << "): ";
     cin >> guess;
     return guess;
 }
-void printAnswer(int guess, int secretNumber)
+void printAnswer(long long guess, long long secretNumber)
 {
-    if (guess > secretNumber)
+    int answer = compareGuess(guess, secretNumber);
+    if (answer > 0)
         {
         cout << "Your number is too big." << endl;
     }
-    else if (guess < secretNumber)
+    else if (answer < 0)
     {
         cout << "Your number is too small." << endl;
     } else
@@ -30,14 +187,63 @@ void printAnswer(int guess, int secretNumber)
     }
 }
 
+void printUsage(const char* program)
+{
+    cout << "Usage: " << program << " [--min N] [--max N] [--batch ROUNDS]"
+         << " [--strategy binary|random] [--adversarial] [--threads N] [--seed N]" << endl;
+}
 
-int main()
+int main(int argc, char* argv[])
 {
-    int secretNumber = generateRandomNumber();
-    int guess;
+    BatchOptions options;
+    bool batch = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--batch") == 0 && hasValue) {
+            batch = true;
+            options.rounds = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--min") == 0 && hasValue) {
+            options.low = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--max") == 0 && hasValue) {
+            options.high = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            options.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--strategy") == 0 && hasValue) {
+            options.strategyName = argv[++i];
+            if (strcmp(options.strategyName, "binary") == 0) options.strategy = binaryGuess;
+            else if (strcmp(options.strategyName, "random") == 0) options.strategy = randomGuess;
+            else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--adversarial") == 0) {
+            options.adversarial = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.high < options.low || options.rounds <= 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (batch) {
+        if (options.seed == 0) options.seed = (unsigned long long)time(0);
+        return runBatch(options);
+    }
+
+    FastRandom rng;
+    rng.seed(options.seed ? options.seed : (unsigned long long)time(0));
+    long long secretNumber = generateRandomNumber(rng, options.low, options.high);
+    long long guess;
 
     do {
-        guess = getPlayerGuess();
+        guess = getPlayerGuess(options.low, options.high);
+        if (!cin) return 1;
         printAnswer(guess, secretNumber);
     }
     while (guess != secretNumber);
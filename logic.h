@@ -5,8 +5,12 @@
 #include <vector>
 #include <algorithm>
 #include <cstdlib>
+#include <cmath>
 #include "defs.h"
 #include "graphics.h"
+#include "snapshot.h"
+#include "chunks.h"
+#include "random.h"
 
 
 const float gravity = 0.30f;
@@ -16,6 +20,7 @@ const float gravityUp = 0.30f;
 const float gravityDown = 0.30f;
 const float maxJumpHeight = 0.0f;
 
+const int rabbitSpriteX = 200;
 const int rabbitX = 245;
 const int rabbitColliderOffsetY = 45;
 const int rabbitColliderW = 130;
@@ -26,8 +31,10 @@ const int carrotHeight = 100;
 bool gameOver = false;
 bool gameWin = false;
 float rabbitY = groundY;
+float previousRabbitY = groundY;
 float velocityY = 0.0f;
 bool isJumping = false;
+EffectEvents effectEvents;
 
 int obstaclesCleared = 0;
 bool carrotAppeared = false;
@@ -39,12 +46,18 @@ bool isGameOver();
 bool isGameWin();
 void resetGame();
 void initRabbit();
-void handleInput(const Uint8* keys);
-void updateRabbit();
+void handleInput(bool jumpHeld);
+void updateRabbit(int ticks = 1);
+bool stepRabbit(float& y, float& v);
 bool checkCollision(const SDL_Rect& a, const SDL_Rect& b);
 bool checkCollisionByType(const SDL_Rect& rabbitRect, const Obstacle& obs);
+float sweptAABB(const SDL_Rect& a, float dx, float dy, const SDL_Rect& b);
+float sweptCircle(float ax, float ay, float ar, float dx, float dy, float bx, float by, float br);
+bool checkSweptCollision(const SDL_Rect& from, const SDL_Rect& to, const SDL_Rect& b);
+bool checkSweptCollisionByType(const SDL_Rect& from, const SDL_Rect& to, const Obstacle& obs);
 SDL_Rect getRabbitCollider(float rabbitY);
 SDL_Rect getObstacleCollider(const Obstacle& obs);
+void setObstacleShape(Obstacle& obs, int type);
 
 class ObstacleManager {
 private:
@@ -54,6 +67,18 @@ private:
     SDL_Texture* grassTexture = nullptr;
     Uint32 lastSpawnTime = 0;
 
+    struct SpeedMark {
+        int originX;
+        int speed;
+    };
+    ChunkQueue* chunks = nullptr;
+    int speed = OBSTACLE_SPEED;
+    int nextChunkX = SCREEN_WIDTH;
+    SpeedMark speedMarks[MAX_SPEED_MARKS];
+    int speedMarkCount = 0;
+    int nextChunkIndex = 0;
+    Random random;
+
 public:
     const std::vector<Obstacle>& getObstacles() const {
         return obstacles;
@@ -65,55 +90,155 @@ public:
         if (!mushroomTexture) mushroomTexture = graphics.loadTexture(MUSHROOM_IMG);
         if (!grassTexture) grassTexture = graphics.loadTexture(GRASS_IMG);
         if (!carrotTexture) carrotTexture = graphics.loadTexture(CARROT_IMG);
+
+        graphics.createVariants(rockTexture, 140, 140);
+        graphics.createVariants(mushroomTexture, 120, 120);
+        graphics.createVariants(grassTexture, 140, 140);
+        graphics.createVariants(carrotTexture, carrotWidth, carrotHeight);
+
+        // Never more on screen than a snapshot can hold, so spawning during
+        // play does not grow the vector.
+        obstacles.reserve(MAX_SNAPSHOT_OBSTACLES);
+    }
+
+    void seed(Uint32 value)
+    {
+        random.seed(value);
+    }
+
+    // Keeps the spawn timer from counting time the game spent paused.
+    void delaySpawns(Uint32 ms)
+    {
+        lastSpawnTime += ms;
     }
 
-    void update() {
-        if (isGameOver() || isGameWin()) return;
+    // Endless mode: obstacles come from pre-generated chunks instead of the
+    // spawn timer, there is no carrot and the speed follows the chunks.
+    void setChunkSource(ChunkQueue* queue)
+    {
+        chunks = queue;
+    }
 
-        Uint32 currentTime = SDL_GetTicks();
-        if (currentTime - lastSpawnTime >= OBSTACLE_SPAWN_INTERVAL) {
-            spawnObstacle();
-            lastSpawnTime = currentTime;
+    bool isEndless() const
+    {
+        return chunks != nullptr;
+    }
+
+    // Moves the world and the rabbit by ticks and returns how far the world
+    // scrolled. Everything runs once per tick and stops at the tick of impact,
+    // so a coarse step ends exactly where single steps would. This costs the
+    // same as single steps; only the caller's per-step work is saved.
+    int update(int ticks = 1) {
+        if (isGameOver() || isGameWin()) return 0;
+
+        if (!isEndless()) {
+            Uint32 currentTime = SDL_GetTicks();
+            if (currentTime - lastSpawnTime >= OBSTACLE_SPAWN_INTERVAL) {
+                spawnObstacle();
+                lastSpawnTime = currentTime;
+            }
         }
 
-        for (auto& obs : obstacles) {
-            obs.x -= OBSTACLE_SPEED;
+        int moved = 0;
+        for (int t = 0; t < ticks; t++) {
+            int step = isEndless() ? advanceChunks() : speed;
+            moved += step;
+
+            for (auto& obs : obstacles) {
+                obs.x -= step;
 
-            if (!obs.passed && obs.x + obs.width < 100) {
-                obs.passed = true;
-                obstaclesCleared++;
+                if (!obs.passed && obs.x + obs.width < 100) {
+                    obs.passed = true;
+                    obstaclesCleared++;
 
-                if (obstaclesCleared >= 30 && !carrotAppeared) {
-                    carrotAppeared = true;
-                    carrotX = SCREEN_WIDTH;
+                    if (!isEndless() && obstaclesCleared >= 30 && !carrotAppeared) {
+                        carrotAppeared = true;
+                        carrotX = SCREEN_WIDTH;
+                    }
                 }
             }
+            if (carrotAppeared) carrotX -= step;
+
+            updateRabbit(1);
+            if (sweepTick(previousRabbitY, rabbitY, step)) break;
         }
 
         obstacles.erase(std::remove_if(obstacles.begin(), obstacles.end(),[](const Obstacle& obs) { return obs.x + obs.width < 0; }), obstacles.end());
+        return moved;
+    }
 
-        SDL_Rect rabbitRect = getRabbitCollider(rabbitY);
+    void writeSnapshot(FrameSnapshot& snapshot) const
+    {
+        snapshot.obstacleCount = 0;
         for (const auto& obs : obstacles) {
-            if (checkCollisionByType(rabbitRect, obs)) {
-                gameOver = true;
-                return;
-            }
+            if (snapshot.obstacleCount >= MAX_SNAPSHOT_OBSTACLES) break;
+            ObstacleView& view = snapshot.obstacles[snapshot.obstacleCount++];
+            view.texture = obs.texture;
+            view.x = obs.x;
+            view.y = obs.y;
+            view.width = obs.width;
+            view.height = obs.height;
         }
-        if (carrotAppeared) {
-           SDL_Rect carrotRect = { static_cast<int>(carrotX + 230), static_cast<int>(groundY + 50), carrotWidth, carrotHeight };
-            if (checkCollision(rabbitRect, carrotRect)) {
-                gameWin = true;
-            }
-            carrotX -= OBSTACLE_SPEED;
+        snapshot.carrotAppeared = carrotAppeared;
+        snapshot.carrotX = carrotX;
+    }
+
+    void writeWorld(WorldSnapshot& world) const
+    {
+        world.obstacleCount = 0;
+        for (const auto& obs : obstacles) {
+            if (world.obstacleCount >= MAX_SNAPSHOT_OBSTACLES) break;
+            WorldObstacle& saved = world.obstacles[world.obstacleCount++];
+            saved.kind = obs.kind;
+            saved.x = obs.x;
+            saved.y = obs.y;
+            saved.passed = obs.passed;
         }
+        world.randomState = random.state;
+        world.spawnElapsed = static_cast<Sint32>(SDL_GetTicks() - lastSpawnTime);
+        world.speed = speed;
+        world.nextChunkX = nextChunkX;
+        world.speedMarkCount = speedMarkCount;
+        for (int i = 0; i < speedMarkCount; i++) {
+            world.speedMarks[i][0] = speedMarks[i].originX;
+            world.speedMarks[i][1] = speedMarks[i].speed;
+        }
+        world.endless = isEndless();
+        world.nextChunkIndex = nextChunkIndex;
     }
 
-    void render(Graphics& graphics) {
-        for (auto& obstacle : obstacles) {
+    void readWorld(const WorldSnapshot& world)
+    {
+        obstacles.clear();
+        for (int i = 0; i < world.obstacleCount && i < MAX_SNAPSHOT_OBSTACLES; i++) {
+            const WorldObstacle& saved = world.obstacles[i];
+            Obstacle restored;
+            restored.x = saved.x;
+            restored.y = saved.y;
+            restored.passed = saved.passed != 0;
+            restored.texture = textureFor(saved.kind);
+            setObstacleShape(restored, saved.kind);
+            obstacles.push_back(restored);
+        }
+        random.state = world.randomState;
+        lastSpawnTime = SDL_GetTicks() - world.spawnElapsed;
+        speed = world.speed;
+        nextChunkX = world.nextChunkX;
+        speedMarkCount = std::min(static_cast<int>(world.speedMarkCount), MAX_SPEED_MARKS);
+        for (int i = 0; i < speedMarkCount; i++) {
+            speedMarks[i].originX = world.speedMarks[i][0];
+            speedMarks[i].speed = world.speedMarks[i][1];
+        }
+        nextChunkIndex = world.nextChunkIndex;
+    }
+
+    void render(Graphics& graphics, const FrameSnapshot& snapshot) {
+        for (int i = 0; i < snapshot.obstacleCount; i++) {
+            const ObstacleView& obstacle = snapshot.obstacles[i];
             graphics.render(obstacle.x, obstacle.y, obstacle.texture, obstacle.width, obstacle.height);
         }
-         if (carrotAppeared) {
-            graphics.render(carrotX + 230, groundY + 50, carrotTexture, carrotWidth, carrotHeight);
+         if (snapshot.carrotAppeared) {
+            graphics.render(snapshot.carrotX + 230, groundY + 50, carrotTexture, carrotWidth, carrotHeight);
         }
     }
 
@@ -121,6 +246,10 @@ public:
     {
         obstacles.clear();
         lastSpawnTime = SDL_GetTicks() + 1000;
+        speed = OBSTACLE_SPEED;
+        nextChunkX = SCREEN_WIDTH;
+        speedMarkCount = 0;
+        nextChunkIndex = 0;
         obstaclesCleared = 0;
         carrotAppeared = false;
         gameWin = false;
@@ -136,37 +265,93 @@ public:
     }
 
 private:
+    // Sweeps the rabbit over one tick instead of testing where it ended up, so
+    // large steps cannot tunnel through anything. Everything else moved left
+    // by step, which is the rabbit moving right by step. Returns whether the
+    // game ended.
+    bool sweepTick(float fromY, float toY, int step)
+    {
+        SDL_Rect rabbitRect = getRabbitCollider(toY);
+        SDL_Rect rabbitFrom = getRabbitCollider(fromY);
+        rabbitFrom.x -= step;
+        for (const auto& obs : obstacles) {
+            if (checkSweptCollisionByType(rabbitFrom, rabbitRect, obs)) {
+                effectEvents.hits++;
+                effectEvents.hitX = obs.x + obs.width / 2;
+                effectEvents.hitY = obs.y + obs.height / 2;
+                gameOver = true;
+                return true;
+            }
+        }
+        if (carrotAppeared) {
+            SDL_Rect carrotRect = { static_cast<int>(carrotX + 230), static_cast<int>(groundY + 50), carrotWidth, carrotHeight };
+            if (checkSweptCollision(rabbitFrom, rabbitRect, carrotRect)) {
+                effectEvents.carrots++;
+                effectEvents.carrotX = carrotRect.x + carrotWidth / 2;
+                effectEvents.carrotY = carrotRect.y + carrotHeight / 2;
+                gameWin = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    SDL_Texture* textureFor(int type) const
+    {
+        switch (type) {
+        case OBSTACLE_ROCK: return rockTexture;
+        case OBSTACLE_MUSHROOM: return mushroomTexture;
+        default: return grassTexture;
+        }
+    }
+
     void spawnObstacle()
     {
-        int type = rand() % 3;
+        int type = random.range(OBSTACLE_KINDS);
         Obstacle newObstacle;
         newObstacle.x = SCREEN_WIDTH;
         newObstacle.y = groundY + 50;
+        newObstacle.texture = textureFor(type);
+        setObstacleShape(newObstacle, type);
+        obstacles.push_back(newObstacle);
+    }
 
-        switch (type) {
-        case 0:
-            newObstacle.texture = rockTexture;
-            newObstacle.width = 140;
-            newObstacle.height = 140;
-            newObstacle.radius = 70;
-            newObstacle.type = "rock";
-            break;
-        case 1:
-            newObstacle.texture = mushroomTexture;
-            newObstacle.width = 120;
-            newObstacle.height = 120;
-            newObstacle.radius = 0;
-            newObstacle.type = "mushroom";
-            break;
-        case 2:
-            newObstacle.texture = grassTexture;
-            newObstacle.width = 140;
-            newObstacle.height = 140;
-            newObstacle.radius = 70;
-            newObstacle.type = "grass";
-            break;
+    // Takes at most one ready chunk and returns how far the world moves this
+    // tick. The chunk was verified with its origin starting exactly at the
+    // rabbit's front edge, so the tick on which an origin crosses that edge is
+    // shortened to land on it before the chunk's own speed takes over.
+    int advanceChunks()
+    {
+        if (nextChunkX <= SCREEN_WIDTH && speedMarkCount < MAX_SPEED_MARKS) {
+            const ObstacleChunk* chunk = chunks->peek();
+            if (chunk) {
+                int originX = std::max(nextChunkX, SCREEN_WIDTH);
+                for (int i = 0; i < chunk->count; i++) {
+                    Obstacle newObstacle;
+                    newObstacle.x = originX + chunk->obstacles[i].offsetX;
+                    newObstacle.y = groundY + 50;
+                    newObstacle.texture = textureFor(chunk->obstacles[i].type);
+                    setObstacleShape(newObstacle, chunk->obstacles[i].type);
+                    obstacles.push_back(newObstacle);
+                }
+                speedMarks[speedMarkCount++] = { originX, chunk->speed };
+                nextChunkX = originX + chunk->length;
+                nextChunkIndex = chunk->index + 1;
+                chunks->pop();
+            }
         }
-        obstacles.push_back(newObstacle);
+
+        const int rabbitFront = rabbitX + rabbitColliderW;
+        int step = speed;
+        if (speedMarkCount > 0 && speedMarks[0].originX - step <= rabbitFront) {
+            step = std::max(0, speedMarks[0].originX - rabbitFront);
+            speed = speedMarks[0].speed;
+            for (int i = 1; i < speedMarkCount; i++) speedMarks[i - 1] = speedMarks[i];
+            speedMarkCount--;
+        }
+        for (int i = 0; i < speedMarkCount; i++) speedMarks[i].originX -= step;
+        nextChunkX = std::max(0, nextChunkX - step);
+        return step;
     }
 };
 
@@ -175,36 +360,57 @@ ObstacleManager obstacleManager;
 void initRabbit()
 {
     rabbitY = groundY;
+    previousRabbitY = groundY;
     velocityY = 0;
     isJumping = false;
 }
 
-void handleInput(const Uint8* keys)
+void handleInput(bool jumpHeld)
 {
     if ((isGameOver() || isGameWin()) || isJumping) return;
 
-    if (keys[SDL_SCANCODE_SPACE]) {
+    if (jumpHeld) {
         velocityY = jumpStrength;
         isJumping = true;
     }
 }
 
-void updateRabbit()
+// One tick of rabbit motion. Returns whether the rabbit is on the ground.
+bool stepRabbit(float& y, float& v)
 {
-    if (isGameOver() || isGameWin()) return;
+    v += (v < 0) ? gravityUp : gravityDown;
+    y += v;
 
-    velocityY += (velocityY < 0) ? gravityUp : gravityDown;
-    rabbitY += velocityY;
+    if (y < maxJumpHeight) {
+        y = maxJumpHeight;
+        v = 0;
+    }
 
-    if (rabbitY < maxJumpHeight) {
-        rabbitY = maxJumpHeight;
-        velocityY = 0;
+    if (y >= groundY) {
+        y = groundY;
+        v = 0;
+        return true;
     }
+    return false;
+}
 
-    if (rabbitY >= groundY) {
-        rabbitY = groundY;
-        velocityY = 0;
-        isJumping = false;
+// Advances the rabbit by ticks. previousRabbitY is where the last tick
+// started, for the swept test.
+void updateRabbit(int ticks)
+{
+    if (isGameOver() || isGameWin()) return;
+
+    for (int i = 0; i < ticks; i++) {
+        previousRabbitY = rabbitY;
+        if (stepRabbit(rabbitY, velocityY)) {
+            if (isJumping) {
+                // Under the middle of the sprite's feet.
+                effectEvents.landings++;
+                effectEvents.landingX = rabbitSpriteX + RABBIT_CLIPS[0][2] / 2;
+                effectEvents.landingY = rabbitY + RABBIT_CLIPS[0][3];
+            }
+            isJumping = false;
+        }
     }
 }
 
@@ -217,7 +423,7 @@ bool checkCollision(const SDL_Rect& a, const SDL_Rect& b)
 }
 
 bool checkCollisionByType(const SDL_Rect& rabbitRect, const Obstacle& obs) {
-    if (obs.type == "mushroom") {
+    if (obs.kind == OBSTACLE_MUSHROOM) {
         SDL_Rect obsRect = getObstacleCollider(obs);
         return checkCollision(rabbitRect, obsRect);
     }
@@ -239,6 +445,73 @@ bool checkCollisionByType(const SDL_Rect& rabbitRect, const Obstacle& obs) {
     return false;
 }
 
+// Time of impact of box a moving by (dx, dy) against the static box b, as a
+// fraction of the move. 0 when they already overlap, > 1 when they never do.
+float sweptAABB(const SDL_Rect& a, float dx, float dy, const SDL_Rect& b)
+{
+    float entry = 0.0f;
+    float exit = 1.0f;
+
+    const float aMin[2] = { (float)a.x, (float)a.y };
+    const float aMax[2] = { (float)(a.x + a.w), (float)(a.y + a.h) };
+    const float bMin[2] = { (float)b.x, (float)b.y };
+    const float bMax[2] = { (float)(b.x + b.w), (float)(b.y + b.h) };
+    const float d[2] = { dx, dy };
+
+    for (int axis = 0; axis < 2; axis++) {
+        if (d[axis] == 0.0f) {
+            if (aMax[axis] <= bMin[axis] || aMin[axis] >= bMax[axis]) return 2.0f;
+            continue;
+        }
+        float t0 = (bMin[axis] - aMax[axis]) / d[axis];
+        float t1 = (bMax[axis] - aMin[axis]) / d[axis];
+        if (t0 > t1) std::swap(t0, t1);
+        entry = std::max(entry, t0);
+        exit = std::min(exit, t1);
+        if (entry >= exit) return 2.0f;
+    }
+    return entry;
+}
+
+// Time of impact of circle a moving by (dx, dy) against the static circle b.
+float sweptCircle(float ax, float ay, float ar, float dx, float dy, float bx, float by, float br)
+{
+    float px = ax - bx;
+    float py = ay - by;
+    float r = ar + br;
+    float c = px * px + py * py - r * r;
+    if (c <= 0.0f) return 0.0f;
+
+    float a = dx * dx + dy * dy;
+    float b = px * dx + py * dy;
+    if (a == 0.0f || b >= 0.0f) return 2.0f;
+
+    float disc = b * b - a * c;
+    if (disc < 0.0f) return 2.0f;
+    return (-b - sqrtf(disc)) / a;
+}
+
+bool checkSweptCollision(const SDL_Rect& from, const SDL_Rect& to, const SDL_Rect& b)
+{
+    return sweptAABB(from, (float)(to.x - from.x), (float)(to.y - from.y), b) <= 1.0f;
+}
+
+// Swept version of checkCollisionByType for a rabbit collider moving from
+// "from" to "to" during one step.
+bool checkSweptCollisionByType(const SDL_Rect& from, const SDL_Rect& to, const Obstacle& obs)
+{
+    if (obs.kind == OBSTACLE_MUSHROOM) {
+        return checkSweptCollision(from, to, getObstacleCollider(obs));
+    }
+    if (obs.radius > 0) {
+        float rabbitRadius = std::min(from.w, from.h) / 2;
+        return sweptCircle(from.x + from.w / 2, from.y + from.h / 2, rabbitRadius,
+                           (float)(to.x - from.x), (float)(to.y - from.y),
+                           obs.x + obs.radius, obs.y + obs.radius, obs.radius) <= 1.0f;
+    }
+    return false;
+}
+
 SDL_Rect getRabbitCollider(float rabbitY)
 {
     return {
@@ -257,6 +530,28 @@ SDL_Rect getObstacleCollider(const Obstacle& obs)
     return { obs.x + 15, obs.y + 10, obs.width - 30, obs.height - 20 };
 }
 
+void setObstacleShape(Obstacle& obs, int type)
+{
+    obs.kind = type;
+    switch (type) {
+    case OBSTACLE_ROCK:
+        obs.width = 140;
+        obs.height = 140;
+        obs.radius = 70;
+        break;
+    case OBSTACLE_MUSHROOM:
+        obs.width = 120;
+        obs.height = 120;
+        obs.radius = 0;
+        break;
+    case OBSTACLE_GRASS:
+        obs.width = 140;
+        obs.height = 140;
+        obs.radius = 70;
+        break;
+    }
+}
+
 float getRabbitY() { return rabbitY; }
 bool isGameOver() { return gameOver; }
 bool isGameWin() { return gameWin; }
@@ -4,11 +4,19 @@
 #include <SDL_ttf.h>
 #include <SDL_mixer.h>
 #include <vector>
+#include <cstring>
+#include <ctime>
 
 #include "defs.h"
 #include "graphics.h"
 #include "logic.h"
 #include "audio.h"
+#include "snapshot.h"
+#include "generator.h"
+#include "particles.h"
+#include "rewind.h"
+#include "power.h"
+#include "alloc_tracking.h"
 
 using namespace std;
 
@@ -17,16 +25,302 @@ bool waitingForKeyRelease = false;
 void waitUntilKeyPressed()
 {
     SDL_Event e;
-    while (true) {
-        if ( SDL_PollEvent(&e) != 0 &&
-             (e.type == SDL_KEYDOWN || e.type == SDL_QUIT) )
+    while (SDL_WaitEvent(&e)) {
+        if (e.type == SDL_KEYDOWN || e.type == SDL_QUIT)
             return;
-        SDL_Delay(100);
     }
 }
 
+// Keys the simulation cares about, sampled on the event thread and handed
+// over as one bitmask.
+const int KEY_JUMP = 1 << 0;
+const int KEY_REWIND = 1 << 1;
+const int KEY_SAVE = 1 << 2;
+const int KEY_LOAD = 1 << 3;
+
+int sampleKeys()
+{
+    const Uint8* keys = SDL_GetKeyboardState(NULL);
+    int held = 0;
+    if (keys[SDL_SCANCODE_SPACE]) held |= KEY_JUMP;
+    if (keys[SDL_SCANCODE_BACKSPACE]) held |= KEY_REWIND;
+    if (keys[SDL_SCANCODE_F5]) held |= KEY_SAVE;
+    if (keys[SDL_SCANCODE_F9]) held |= KEY_LOAD;
+    return held;
+}
+
+struct Simulation {
+    ScrollingBackground* background;
+    Sprite* redBird;
+    Sprite* rabbit;
+    ChunkGenerator* generator = nullptr;
+    TripleBuffer frames;
+    SDL_atomic_t running;
+    SDL_atomic_t paused;
+    SDL_atomic_t wakeups;
+    SDL_atomic_t keys;
+    SDL_sem* wake = nullptr;
+    int redBirdTickCounter = 0;
+    int rabbitTickCounter = 0;
+    Uint32 tick = 0;
+
+    WorldSnapshot world;
+    AllocationScope tickScope = { "simulation tick", true, { 0 } };
+    bool rewindHeld = false;
+    bool saveHeld = false;
+    bool loadHeld = false;
+
+    // Returns whether the world moved, i.e. whether this tick is worth recording.
+    bool step(int ticks)
+    {
+        int held = SDL_AtomicGet(&keys);
+        handleControls(held);
+
+        if (isGameOver() || isGameWin()) return false;
+
+        // Saving and loading above may allocate; a running tick must not.
+        AllocationGuard guard(tickScope);
+        handleInput((held & KEY_JUMP) != 0);
+        background->scroll(obstacleManager.update(ticks));
+
+        redBirdTickCounter += 10 * ticks;
+        if (redBirdTickCounter >= redBirdTickDelay) {
+            redBird->tick();
+            redBirdTickCounter = 0;
+        }
+
+        rabbitTickCounter += 10 * ticks;
+        if (rabbitTickCounter >= rabbitTickDelay) {
+            rabbit->tick();
+            rabbitTickCounter = 0;
+        }
+        tick += ticks;
+        return true;
+    }
+
+    // Backspace rewinds the last couple of seconds (also after losing),
+    // F5 saves the current world and F9 loads it back.
+    void handleControls(int held)
+    {
+        bool rewindKey = (held & KEY_REWIND) != 0;
+        bool saveKey = (held & KEY_SAVE) != 0;
+        bool loadKey = (held & KEY_LOAD) != 0;
+
+        if (rewindKey && !rewindHeld && rewindBuffer.rewind(REWIND_STEP_TICKS, world)) {
+            restore(world);
+        }
+        if (saveKey && !saveHeld) {
+            capture(world);
+            saveWorld(SAVE_FILE, world);
+        }
+        if (loadKey && !loadHeld && loadWorld(SAVE_FILE, world, obstacleManager.isEndless())) {
+            restore(world);
+            rewindBuffer.clear();
+        }
+
+        rewindHeld = rewindKey;
+        saveHeld = saveKey;
+        loadHeld = loadKey;
+    }
+
+    void capture(WorldSnapshot& snapshot)
+    {
+        captureLogic(snapshot);
+        snapshot.tick = tick;
+        snapshot.rabbitFrame = rabbit->currentFrame;
+        snapshot.redBirdFrame = redBird->currentFrame;
+        snapshot.rabbitTickCounter = rabbitTickCounter;
+        snapshot.redBirdTickCounter = redBirdTickCounter;
+        snapshot.backgroundOffset = background->scrollingOffset;
+        snapshot.chunkSeed = generator ? generator->seed : 0;
+    }
+
+    void restore(const WorldSnapshot& snapshot)
+    {
+        restoreLogic(snapshot);
+        tick = snapshot.tick;
+        rabbit->currentFrame = snapshot.rabbitFrame % RABBIT_FRAMES;
+        redBird->currentFrame = snapshot.redBirdFrame % RED_BIRD_FRAMES;
+        rabbitTickCounter = snapshot.rabbitTickCounter;
+        redBirdTickCounter = snapshot.redBirdTickCounter;
+        background->setX(snapshot.backgroundOffset);
+        if (generator) generator->restart(snapshot.chunkSeed, snapshot.nextChunkIndex);
+    }
+
+    void record()
+    {
+        capture(world);
+        rewindBuffer.push(world);
+    }
+
+    void publish()
+    {
+        FrameSnapshot& snapshot = frames.writeSlot();
+        snapshot.tick = tick;
+        snapshot.rabbitY = getRabbitY();
+        snapshot.rabbitFrame = rabbit->currentFrame;
+        snapshot.redBirdFrame = redBird->currentFrame;
+        snapshot.backgroundOffset = background->scrollingOffset;
+        snapshot.effects = effectEvents;
+        obstacleManager.writeSnapshot(snapshot);
+        snapshot.gameOver = isGameOver();
+        snapshot.gameWin = isGameWin();
+        frames.publish();
+    }
+};
+
+int runSimulation(void* data)
+{
+    Simulation* sim = static_cast<Simulation*>(data);
+    Uint32 nextTick = SDL_GetTicks();
+
+    while (SDL_AtomicGet(&sim->running)) {
+        SDL_AtomicAdd(&sim->wakeups, 1);
+
+        // The render thread posts on every input and window event, also while
+        // we are busy ticking. Drop those posts before looking at the state:
+        // anything that changes after this point posts again, so the wait
+        // below cannot miss it, and it cannot fall through on stale posts.
+        while (SDL_SemTryWait(sim->wake) == 0) {}
+
+        // When the thread falls behind, catch up with one coarse step instead
+        // of several small ones. The world still moves and collides tick by
+        // tick inside it, at the same cost; only input, recording and
+        // publishing run once.
+        Uint32 now = SDL_GetTicks();
+        int ticks = 1;
+        if (now > nextTick) {
+            ticks = std::min(1 + static_cast<int>((now - nextTick) / SIMULATION_TICK_MS), MAX_CATCHUP_TICKS);
+        }
+        bool paused = SDL_AtomicGet(&sim->paused) != 0;
+        bool advanced = !paused && sim->step(ticks);
+        if (advanced) sim->record();
+        sim->publish();
+
+        // Nothing moves while paused, lost or won: sleep until the render
+        // thread passes on some input instead of ticking for nothing.
+        if (!advanced) {
+            SDL_SemWaitTimeout(sim->wake, IDLE_WAIT_TIMEOUT_MS);
+            Uint32 slept = SDL_GetTicks() - now;
+            if (paused) obstacleManager.delaySpawns(slept);
+            nextTick = SDL_GetTicks();
+            continue;
+        }
+
+        nextTick += SIMULATION_TICK_MS * ticks;
+        now = SDL_GetTicks();
+        if (nextTick > now) {
+            SDL_Delay(nextTick - now);
+        } else if (now - nextTick > SIMULATION_TICK_MS * MAX_CATCHUP_TICKS) {
+            nextTick = now;
+        }
+    }
+    return 0;
+}
+
+// Turns effect totals that grew since the last rendered frame into bursts.
+void emitEffects(const EffectEvents& seen, const EffectEvents& current)
+{
+    if (current.landings != seen.landings) {
+        particles.emit(DUST_BURST, current.landingX, current.landingY);
+    }
+    if (current.hits != seen.hits) {
+        particles.emit(DEBRIS_BURST, current.hitX, current.hitY);
+    }
+    if (current.carrots != seen.carrots) {
+        particles.emit(SPARKLE_BURST, current.carrotX, current.carrotY);
+    }
+}
+
+struct RenderLoop {
+    bool quit = false;
+    bool paused = false;
+    bool idlePresented = false;
+    Uint32 awakeUntil = 0;
+};
+
+void handleEvent(const SDL_Event& event, RenderLoop& loop, Simulation& sim, Graphics& graphics, Audio& audio)
+{
+    bool pause = loop.paused;
+    bool wakeSimulation = true;
+
+    switch (event.type) {
+    case SDL_QUIT:
+        loop.quit = true;
+        break;
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+        SDL_AtomicSet(&sim.keys, sampleKeys());
+        loop.awakeUntil = SDL_GetTicks() + INPUT_GRACE_MS;
+        break;
+    case SDL_MOUSEBUTTONDOWN:
+        loop.awakeUntil = SDL_GetTicks() + INPUT_GRACE_MS;
+        break;
+    case SDL_WINDOWEVENT:
+        switch (event.window.event) {
+        case SDL_WINDOWEVENT_SIZE_CHANGED:
+            graphics.updateOutputScale();
+            break;
+        case SDL_WINDOWEVENT_MINIMIZED:
+        case SDL_WINDOWEVENT_FOCUS_LOST:
+            pause = true;
+            break;
+        case SDL_WINDOWEVENT_RESTORED:
+        case SDL_WINDOWEVENT_FOCUS_GAINED:
+            pause = false;
+            break;
+        }
+        loop.idlePresented = false;
+        break;
+    case SDL_RENDER_TARGETS_RESET:
+        graphics.refreshVariants();
+        loop.idlePresented = false;
+        break;
+    default:
+        wakeSimulation = false;
+        break;
+    }
+
+    if (pause != loop.paused) {
+        loop.paused = pause;
+        SDL_AtomicSet(&sim.paused, pause);
+        if (pause) audio.pause();
+        else audio.resume();
+        SDL_Log(pause ? "Window inactive, game paused" : "Window active, game resumed");
+    }
+    if (wakeSimulation) SDL_SemPost(sim.wake);
+}
+
+void renderSnapshot(Graphics& graphics, FrameArena& arena, const FrameSnapshot& snapshot, const ScrollingBackground& background,
+                    const Sprite& redBird, const Sprite& rabbit, SDL_Texture* notificationBoard)
+{
+    // Only the fields the simulation thread never writes are copied.
+    ScrollingBackground view;
+    view.texture = background.texture;
+    view.width = background.width;
+    view.height = background.height;
+    view.setX(snapshot.backgroundOffset);
+
+    graphics.prepareScene();
+    graphics.render(view);
+    graphics.render(110, 50, redBird, snapshot.redBirdFrame);
+    graphics.render(rabbitSpriteX, snapshot.rabbitY, rabbit, snapshot.rabbitFrame);
+    obstacleManager.render(graphics, snapshot);
+    particles.render(graphics, arena);
+
+    if (snapshot.gameOver) {
+        graphics.renderGameOver(notificationBoard);
+    }
+    if (snapshot.gameWin) {
+        graphics.renderGameWin(notificationBoard);
+    }
+    graphics.presentScene();
+}
+
 int main(int argc, char* argv[])
 {
+    installAllocationHooks();
+
     Graphics graphics;
     graphics.init();
 
@@ -45,79 +339,140 @@ int main(int argc, char* argv[])
     SDL_Texture* rabbitTexture = graphics.loadTexture(RABBIT_SPRITE_FILE);
     rabbit.init(rabbitTexture, RABBIT_FRAMES, RABBIT_CLIPS);
 
+    graphics.createVariants(redBirdTexture);
+    graphics.createVariants(rabbitTexture);
+
     obstacleManager.loadTextures(graphics);
+    obstacleManager.seed(static_cast<Uint32>(time(NULL)));
 
-    SDL_Texture* notificationBoard = graphics.loadTexture(NOTIFICATION_BOARD_IMG);
+    bool endless = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--endless") == 0) endless = true;
+    }
 
-    int redBirdTickCounter = 0;
-    int rabbitTickCounter = 0;
+    ChunkGenerator chunkGenerator;
+    if (endless) {
+        chunkGenerator.start(SDL_GetTicks() ^ static_cast<Uint32>(time(NULL)));
+        obstacleManager.setChunkSource(&chunkGenerator.queue);
+    }
 
+    SDL_Texture* notificationBoard = graphics.loadTexture(NOTIFICATION_BOARD_IMG);
+    graphics.createVariants(notificationBoard, 400, 200);
 
     initRabbit();
 
-    bool quit = false;
-    bool isGameOverState = false;
-    bool isGameWinState = false;
+    Simulation sim;
+    sim.background = &background;
+    sim.redBird = &redBird;
+    sim.rabbit = &rabbit;
+    if (endless) sim.generator = &chunkGenerator;
+    sim.frames.init();
+    sim.publish();
+    SDL_AtomicSet(&sim.running, 1);
+    SDL_AtomicSet(&sim.paused, 0);
+    SDL_AtomicSet(&sim.wakeups, 0);
+    SDL_AtomicSet(&sim.keys, 0);
+    sim.wake = SDL_CreateSemaphore(0);
+
+    SDL_Thread* simThread = SDL_CreateThread(runSimulation, "simulation", &sim);
+    if (simThread == nullptr) graphics.logErrorAndExit("CreateThread", SDL_GetError());
+
+    particles.init();
+    FrameArena frameArena;
+    frameArena.init(PARTICLE_VERTEX_BYTES);
+    // Counted only: the renderer and audio drivers grow their own buffers now
+    // and then, which is outside our control.
+    AllocationScope frameScope = { "gameplay frame", false, { 0 } };
+    EffectEvents seenEffects = sim.frames.latest().effects;
+    Uint32 lastFrameTime = SDL_GetTicks();
+    Uint32 nextFrame = lastFrameTime;
+
+    RenderLoop loop;
+    PowerMonitor power;
+    power.start();
+    bool wasIdle = false;
     bool hasPlayedEndSound = false;
     SDL_Event event;
 
-     while (!quit) {
+    while (!loop.quit) {
+        power.renderWakeups++;
+        frameArena.reset();
         while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) quit = true;
-            }
+            handleEvent(event, loop, sim, graphics, audio);
+        }
+
+        const FrameSnapshot& snapshot = sim.frames.latest();
+
+        Uint32 now = SDL_GetTicks();
+        emitEffects(seenEffects, snapshot.effects);
+        seenEffects = snapshot.effects;
+        particles.update(static_cast<float>(now - lastFrameTime) / SIMULATION_TICK_MS);
+        lastFrameTime = now;
 
-            const Uint8* currentKeyStates = SDL_GetKeyboardState(NULL);
-
-            if (!isGameOverState && !isGameWinState) {
-                handleInput(currentKeyStates);
-                updateRabbit();
-                obstacleManager.update();
-                background.scroll(4);
-
-                redBirdTickCounter += 10;
-                if (redBirdTickCounter >= redBirdTickDelay) {
-                    redBird.tick();
-                    redBirdTickCounter = 0;
-                }
-
-                rabbitTickCounter += 10;
-                if (rabbitTickCounter >= rabbitTickDelay) {
-                    rabbit.tick();
-                    rabbitTickCounter = 0;
-                }
-                if (isGameOver()) {
-                    isGameOverState = true;
-                }
-                if (isGameWin()) {
-                    isGameWinState = true;
-                }
+        if (!snapshot.gameOver && !snapshot.gameWin) hasPlayedEndSound = false;
+        if (!hasPlayedEndSound) {
+            if (snapshot.gameOver) {
+                audio.playLoseSound();
+                hasPlayedEndSound = true;
             }
-            if (!hasPlayedEndSound) {
-                if (isGameOverState) {
-                    audio.playLoseSound();
-                    hasPlayedEndSound = true;
-                }
-                if (isGameWinState) {
-                    audio.playWinSound();
-                    hasPlayedEndSound = true;
-                }
+            if (snapshot.gameWin) {
+                audio.playWinSound();
+                hasPlayedEndSound = true;
             }
-            graphics.prepareScene();
-            graphics.render(background);
-            graphics.render(110, 50, redBird);
-            graphics.render(200, getRabbitY(), rabbit);
-            obstacleManager.render(graphics);
-
-            if (isGameOverState) {
-                graphics.renderGameOver(notificationBoard);
+        }
+
+        // Once nothing on screen can change without input, show the last
+        // frame once and then sleep in the event queue.
+        bool idle = (loop.paused || snapshot.gameOver || snapshot.gameWin) &&
+                    particles.count == 0 && SDL_TICKS_PASSED(now, loop.awakeUntil);
+        if (idle != wasIdle) {
+            const char* phase = wasIdle ? "Idle" : "Active";
+            power.report(phase, SDL_AtomicSet(&sim.wakeups, 0));
+            logAllocations(phase, sim.tickScope, frameScope);
+            wasIdle = idle;
+        }
+
+        if (idle) {
+            if (!loop.idlePresented) {
+                renderSnapshot(graphics, frameArena, snapshot, background, redBird, rabbit, notificationBoard);
+                power.framesPresented++;
+                loop.idlePresented = true;
             }
-            if (isGameWinState) {
-                graphics.renderGameWin(notificationBoard);
+            if (SDL_WaitEventTimeout(&event, IDLE_WAIT_TIMEOUT_MS)) {
+                handleEvent(event, loop, sim, graphics, audio);
             }
-            graphics.presentScene();
-            SDL_Delay(16);
+            lastFrameTime = SDL_GetTicks();
+            continue;
+        }
+        loop.idlePresented = false;
+
+        AllocationGuard guard(frameScope);
+        renderSnapshot(graphics, frameArena, snapshot, background, redBird, rabbit, notificationBoard);
+        power.framesPresented++;
+
+        // Without vsync (software renderer, driver ignoring PRESENTVSYNC)
+        // present returns at once and the loop would spin, so sleep out the
+        // rest of the display's refresh interval instead.
+        Uint32 interval = graphics.frameInterval();
+        if (interval > 0) {
+            nextFrame += interval;
+            Uint32 presented = SDL_GetTicks();
+            if (SDL_TICKS_PASSED(presented, nextFrame)) nextFrame = presented;
+            else SDL_Delay(nextFrame - presented);
+        }
     }
 
+    const char* phase = wasIdle ? "Idle" : "Active";
+    power.report(phase, SDL_AtomicSet(&sim.wakeups, 0));
+    logAllocations(phase, sim.tickScope, frameScope);
+    frameArena.release();
+
+    SDL_AtomicSet(&sim.running, 0);
+    SDL_SemPost(sim.wake);
+    SDL_WaitThread(simThread, NULL);
+    SDL_DestroySemaphore(sim.wake);
+    if (endless) chunkGenerator.stop();
+
     SDL_DestroyTexture(background.texture); background.texture = nullptr;
     SDL_DestroyTexture(redBirdTexture); redBirdTexture = nullptr;
     SDL_DestroyTexture(rabbitTexture); rabbitTexture = nullptr;
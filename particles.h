@@ -0,0 +1,152 @@
+#ifndef _PARTICLES_H
+#define _PARTICLES_H
+#include <SDL.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PARTICLES_SSE 1
+#endif
+#include "defs.h"
+#include "graphics.h"
+#include "random.h"
+#include "alloc_tracking.h"
+
+const int MAX_PARTICLES = 32768;
+const float PARTICLE_GRAVITY = 0.25f;
+const float PARTICLE_SIZE = 4.0f;
+// Frame arena space for one quad per particle.
+const size_t PARTICLE_VERTEX_BYTES = MAX_PARTICLES * 4 * sizeof(SDL_Vertex);
+
+struct ParticleBurst {
+    int count;
+    float speed;
+    float upward;
+    float life;
+    SDL_Color color;
+};
+
+const ParticleBurst DUST_BURST = { 24, 2.0f, 1.5f, 30.0f, { 181, 155, 120, 255 } };
+const ParticleBurst DEBRIS_BURST = { 80, 5.0f, 4.0f, 50.0f, { 120, 100, 80, 255 } };
+const ParticleBurst SPARKLE_BURST = { 150, 4.0f, 3.0f, 70.0f, { 255, 215, 80, 255 } };
+
+// Cosmetic particles, simulated and drawn on the render thread.
+// Storage is structure-of-arrays in a fixed pool so the integration step can
+// run four particles at a time, and everything that is alive goes out in one
+// SDL_RenderGeometry call, with the vertices built in the frame arena.
+struct ParticleSystem {
+    alignas(16) float x[MAX_PARTICLES];
+    alignas(16) float y[MAX_PARTICLES];
+    alignas(16) float vx[MAX_PARTICLES];
+    alignas(16) float vy[MAX_PARTICLES];
+    alignas(16) float life[MAX_PARTICLES];
+    float maxLife[MAX_PARTICLES];
+    SDL_Color color[MAX_PARTICLES];
+    int count = 0;
+
+    int indices[MAX_PARTICLES * 6];
+    Random random;
+
+    void init()
+    {
+        count = 0;
+        for (int i = 0; i < MAX_PARTICLES; i++) {
+            int* quad = &indices[i * 6];
+            quad[0] = i * 4;
+            quad[1] = i * 4 + 1;
+            quad[2] = i * 4 + 2;
+            quad[3] = i * 4 + 2;
+            quad[4] = i * 4 + 3;
+            quad[5] = i * 4;
+        }
+    }
+
+    void emit(const ParticleBurst& burst, float originX, float originY)
+    {
+        for (int i = 0; i < burst.count && count < MAX_PARTICLES; i++) {
+            float angle = random.range(6284) / 1000.0f;
+            float speed = burst.speed * (0.25f + random.range(1000) / 1333.0f);
+            x[count] = originX;
+            y[count] = originY;
+            vx[count] = SDL_cosf(angle) * speed;
+            vy[count] = SDL_sinf(angle) * speed - burst.upward;
+            life[count] = burst.life * (0.5f + random.range(1000) / 2000.0f);
+            maxLife[count] = life[count];
+            color[count] = burst.color;
+            count++;
+        }
+    }
+
+    // dt is measured in simulation ticks, so bursts look the same whatever
+    // the display rate is.
+    void update(float dt)
+    {
+        int i = 0;
+#ifdef PARTICLES_SSE
+        const __m128 step = _mm_set1_ps(dt);
+        const __m128 fall = _mm_set1_ps(PARTICLE_GRAVITY * dt);
+        for (; i + 4 <= count; i += 4) {
+            __m128 px = _mm_load_ps(&x[i]);
+            __m128 py = _mm_load_ps(&y[i]);
+            __m128 pvx = _mm_load_ps(&vx[i]);
+            __m128 pvy = _mm_add_ps(_mm_load_ps(&vy[i]), fall);
+            _mm_store_ps(&x[i], _mm_add_ps(px, _mm_mul_ps(pvx, step)));
+            _mm_store_ps(&y[i], _mm_add_ps(py, _mm_mul_ps(pvy, step)));
+            _mm_store_ps(&vy[i], pvy);
+            _mm_store_ps(&life[i], _mm_sub_ps(_mm_load_ps(&life[i]), step));
+        }
+#endif
+        for (; i < count; i++) {
+            vy[i] += PARTICLE_GRAVITY * dt;
+            x[i] += vx[i] * dt;
+            y[i] += vy[i] * dt;
+            life[i] -= dt;
+        }
+
+        for (i = 0; i < count; ) {
+            if (life[i] > 0.0f && y[i] < SCREEN_HEIGHT) {
+                i++;
+                continue;
+            }
+            count--;
+            x[i] = x[count];
+            y[i] = y[count];
+            vx[i] = vx[count];
+            vy[i] = vy[count];
+            life[i] = life[count];
+            maxLife[i] = maxLife[count];
+            color[i] = color[count];
+        }
+    }
+
+    void render(Graphics& graphics, FrameArena& arena)
+    {
+        int drawn = std::min(count, arena.room<SDL_Vertex>() / 4);
+        if (drawn == 0) return;
+        SDL_Vertex* vertices = arena.allocate<SDL_Vertex>(drawn * 4);
+
+        const float half = PARTICLE_SIZE / 2;
+        for (int i = 0; i < drawn; i++) {
+            SDL_Color c = color[i];
+            c.a = static_cast<Uint8>(255.0f * life[i] / maxLife[i]);
+
+            SDL_Vertex* quad = &vertices[i * 4];
+            quad[0].position = { x[i] - half, y[i] - half };
+            quad[1].position = { x[i] + half, y[i] - half };
+            quad[2].position = { x[i] + half, y[i] + half };
+            quad[3].position = { x[i] - half, y[i] + half };
+            for (int v = 0; v < 4; v++) {
+                quad[v].color = c;
+                quad[v].tex_coord = { 0.0f, 0.0f };
+            }
+        }
+        graphics.renderGeometry(NULL, vertices, drawn * 4, indices, drawn * 6);
+    }
+
+    void clear()
+    {
+        count = 0;
+    }
+};
+
+ParticleSystem particles;
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _POWER_H
+#define _POWER_H
+#include <SDL.h>
+#include <ctime>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+// CPU time used by the whole process so far, in milliseconds.
+double processCpuMs()
+{
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) / 10000.0;
+#else
+    return clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif
+}
+
+// Counts how often the threads wake up and how much CPU they burn between two
+// reports, so the active and idle phases can be compared from the log.
+struct PowerMonitor {
+    Uint32 intervalStart = 0;
+    double cpuStart = 0.0;
+    Uint32 renderWakeups = 0;
+    Uint32 framesPresented = 0;
+
+    void start()
+    {
+        intervalStart = SDL_GetTicks();
+        cpuStart = processCpuMs();
+        renderWakeups = 0;
+        framesPresented = 0;
+    }
+
+    void report(const char* phase, int simulationWakeups)
+    {
+        Uint32 wall = SDL_GetTicks() - intervalStart;
+        double cpu = processCpuMs() - cpuStart;
+        SDL_Log("%s for %u ms: %.0f ms CPU (%.1f%% of one core), %u frames, %u render wakeups, %d simulation wakeups",
+                phase, wall, cpu, wall ? 100.0 * cpu / wall : 0.0, framesPresented, renderWakeups, simulationWakeups);
+        start();
+    }
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef RABBIT_RANDOM_H
+#define RABBIT_RANDOM_H
+#include <SDL.h>
+
+// Small seedable xorshift32 generator. Unlike rand() it keeps its whole state
+// in one word, so every thread can own its own stream.
+struct Random {
+    Uint32 state = 2463534242u;
+
+    void seed(Uint32 value)
+    {
+        state = value ? value : 2463534242u;
+    }
+
+    Uint32 next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    int range(int n)
+    {
+        return static_cast<int>(next() % static_cast<Uint32>(n));
+    }
+
+    int between(int low, int high)
+    {
+        return low + range(high - low + 1);
+    }
+};
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef _REWIND_H
+#define _REWIND_H
+#include <SDL.h>
+#include <cstring>
+#include "defs.h"
+#include "snapshot.h"
+#include "logic.h"
+#include "generator.h"
+
+const int REWIND_RECORDS = 320;
+const int REWIND_KEYFRAME_INTERVAL = 30;
+const int REWIND_BUFFER_BYTES = 64 * 1024;
+const int REWIND_STEP_TICKS = 120;
+
+const char SAVE_MAGIC[4] = { 'R', 'B', 'W', 'S' };
+const Uint32 SAVE_VERSION = 2;
+
+// Copies the logic.h globals and the obstacle manager into world. Fields the
+// simulation thread owns (sprite frames, tick) are left for the caller.
+void captureLogic(WorldSnapshot& world)
+{
+    memset(&world, 0, sizeof(world));
+    world.rabbitY = rabbitY;
+    world.previousRabbitY = previousRabbitY;
+    world.velocityY = velocityY;
+    world.isJumping = isJumping;
+    world.gameOver = gameOver;
+    world.gameWin = gameWin;
+    world.obstaclesCleared = obstaclesCleared;
+    world.carrotAppeared = carrotAppeared;
+    world.carrotX = carrotX;
+    obstacleManager.writeWorld(world);
+}
+
+void restoreLogic(const WorldSnapshot& world)
+{
+    rabbitY = world.rabbitY;
+    previousRabbitY = world.previousRabbitY;
+    velocityY = world.velocityY;
+    isJumping = world.isJumping != 0;
+    gameOver = world.gameOver != 0;
+    gameWin = world.gameWin != 0;
+    obstaclesCleared = world.obstaclesCleared;
+    carrotAppeared = world.carrotAppeared != 0;
+    carrotX = world.carrotX;
+    obstacleManager.readWorld(world);
+}
+
+struct RewindRecord {
+    Uint32 tick;
+    int offset;
+    int size;
+    bool keyframe;
+};
+
+// The last few seconds of WorldSnapshots, one per simulation step, in a preallocated
+// byte ring. Every REWIND_KEYFRAME_INTERVAL ticks a full snapshot is stored;
+// in between only the 4-byte words that changed since the previous tick are
+// kept, as (start word, word count, words) spans. The oldest records are
+// dropped as the ring wraps, along with any deltas left without a keyframe.
+struct RewindBuffer {
+    Uint8 bytes[REWIND_BUFFER_BYTES];
+    RewindRecord records[REWIND_RECORDS];
+    int first = 0;
+    int count = 0;
+    int writeOffset = 0;
+    int sinceKeyframe = 0;
+    WorldSnapshot previous;
+    Uint8 scratch[sizeof(WorldSnapshot)];
+
+    void clear()
+    {
+        first = 0;
+        count = 0;
+        writeOffset = 0;
+        sinceKeyframe = 0;
+    }
+
+    RewindRecord& record(int i)
+    {
+        return records[(first + i) % REWIND_RECORDS];
+    }
+
+    void push(const WorldSnapshot& world)
+    {
+        bool keyframe = count == 0 || sinceKeyframe >= REWIND_KEYFRAME_INTERVAL;
+        int size = keyframe ? -1 : encodeDelta(previous, world, scratch);
+        if (size < 0) {
+            keyframe = true;
+            size = sizeof(WorldSnapshot);
+        }
+
+        makeRoom(size);
+        if (count == 0 && !keyframe) {
+            keyframe = true;
+            size = sizeof(WorldSnapshot);
+            makeRoom(size);
+        }
+
+        memcpy(&bytes[writeOffset], keyframe ? reinterpret_cast<const Uint8*>(&world) : scratch, size);
+        RewindRecord& added = records[(first + count) % REWIND_RECORDS];
+        added.tick = world.tick;
+        added.offset = writeOffset;
+        added.size = size;
+        added.keyframe = keyframe;
+        count++;
+
+        writeOffset += size;
+        sinceKeyframe = keyframe ? 1 : sinceKeyframe + 1;
+        previous = world;
+    }
+
+    // Rebuilds the newest state at least ticksBack ticks older than the last
+    // record (or the oldest one kept) into world and forgets everything newer,
+    // so recording carries on from there. A record covers a whole catch-up
+    // step, so the target is found by tick rather than by counting records.
+    // Returns false when nothing has been recorded yet.
+    bool rewind(int ticksBack, WorldSnapshot& world)
+    {
+        if (count == 0) return false;
+
+        Uint32 newest = record(count - 1).tick;
+        int target = count - 1;
+        while (target > 0 && newest - record(target).tick < static_cast<Uint32>(ticksBack)) target--;
+        int key = target;
+        while (key > 0 && !record(key).keyframe) key--;
+
+        for (int i = key; i <= target; i++) {
+            const RewindRecord& r = record(i);
+            if (r.keyframe) memcpy(&world, &bytes[r.offset], sizeof(WorldSnapshot));
+            else applyDelta(world, &bytes[r.offset], r.size);
+        }
+
+        count = target + 1;
+        writeOffset = record(target).offset + record(target).size;
+        sinceKeyframe = target - key + 1;
+        previous = world;
+        return true;
+    }
+
+    static int encodeDelta(const WorldSnapshot& base, const WorldSnapshot& world, Uint8* out)
+    {
+        const Uint8* from = reinterpret_cast<const Uint8*>(&base);
+        const Uint8* to = reinterpret_cast<const Uint8*>(&world);
+        const int words = sizeof(WorldSnapshot) / 4;
+        int size = 0;
+
+        for (int i = 0; i < words; ) {
+            if (memcmp(from + i * 4, to + i * 4, 4) == 0) {
+                i++;
+                continue;
+            }
+            int start = i;
+            while (i < words && memcmp(from + i * 4, to + i * 4, 4) != 0) i++;
+
+            Uint16 span[2] = { static_cast<Uint16>(start), static_cast<Uint16>(i - start) };
+            if (size + 4 + span[1] * 4 >= static_cast<int>(sizeof(WorldSnapshot))) return -1;
+            memcpy(out + size, span, 4);
+            memcpy(out + size + 4, to + start * 4, span[1] * 4);
+            size += 4 + span[1] * 4;
+        }
+        return size;
+    }
+
+    static void applyDelta(WorldSnapshot& world, const Uint8* delta, int size)
+    {
+        Uint8* to = reinterpret_cast<Uint8*>(&world);
+        for (int offset = 0; offset < size; ) {
+            Uint16 span[2];
+            memcpy(span, delta + offset, 4);
+            memcpy(to + span[0] * 4, delta + offset + 4, span[1] * 4);
+            offset += 4 + span[1] * 4;
+        }
+    }
+
+private:
+    void dropOldest()
+    {
+        first = (first + 1) % REWIND_RECORDS;
+        count--;
+        while (count > 0 && !record(0).keyframe) {
+            first = (first + 1) % REWIND_RECORDS;
+            count--;
+        }
+    }
+
+    // Records sit in the byte ring in the order they were written, so the ones
+    // in the way of the next write are always the oldest ones.
+    void makeRoom(int size)
+    {
+        if (writeOffset + size > REWIND_BUFFER_BYTES) {
+            int end = writeOffset;
+            writeOffset = 0;
+            while (count > 0 && record(0).offset >= end) dropOldest();
+        }
+        while (count > 0 && (count == REWIND_RECORDS ||
+               (record(0).offset < writeOffset + size && writeOffset < record(0).offset + record(0).size))) {
+            dropOldest();
+        }
+    }
+};
+
+RewindBuffer rewindBuffer;
+
+// Save files are a small header followed by the raw WorldSnapshot, in the
+// byte order of the machine that wrote them.
+bool saveWorld(const char* path, const WorldSnapshot& world)
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "wb");
+    if (file == nullptr) {
+        SDL_Log("Unable to open %s for writing: %s", path, SDL_GetError());
+        return false;
+    }
+    Uint32 header[2] = { SAVE_VERSION, static_cast<Uint32>(sizeof(WorldSnapshot)) };
+    bool ok = SDL_RWwrite(file, SAVE_MAGIC, sizeof(SAVE_MAGIC), 1) == 1 &&
+              SDL_RWwrite(file, header, sizeof(header), 1) == 1 &&
+              SDL_RWwrite(file, &world, sizeof(WorldSnapshot), 1) == 1;
+    SDL_RWclose(file);
+    if (!ok) SDL_Log("Unable to write %s: %s", path, SDL_GetError());
+    return ok;
+}
+
+// Everything a save file holds that ends up as an index, a count or a
+// speed is checked, along with the game mode it was written in.
+bool isValidWorld(const WorldSnapshot& world, bool endless)
+{
+    if ((world.endless != 0) != endless) {
+        SDL_Log("Save file is from %s mode", world.endless ? "endless" : "classic");
+        return false;
+    }
+    if (!(world.rabbitY >= maxJumpHeight && world.rabbitY <= groundY)) return false;
+    if (world.rabbitFrame < 0 || world.rabbitFrame >= RABBIT_FRAMES) return false;
+    if (world.redBirdFrame < 0 || world.redBirdFrame >= RED_BIRD_FRAMES) return false;
+    if (world.speed <= 0 || world.speed > MAX_OBSTACLE_SPEED) return false;
+    if (!endless && world.speed != OBSTACLE_SPEED) return false;
+    if (endless && world.carrotAppeared) return false;
+
+    if (world.obstacleCount < 0 || world.obstacleCount > MAX_SNAPSHOT_OBSTACLES) return false;
+    for (int i = 0; i < world.obstacleCount; i++) {
+        if (world.obstacles[i].kind < 0 || world.obstacles[i].kind >= OBSTACLE_KINDS) return false;
+    }
+    if (world.speedMarkCount < 0 || world.speedMarkCount > MAX_SPEED_MARKS) return false;
+    for (int i = 0; i < world.speedMarkCount; i++) {
+        if (world.speedMarks[i][1] <= 0 || world.speedMarks[i][1] > MAX_OBSTACLE_SPEED) return false;
+    }
+    return world.nextChunkIndex >= 0;
+}
+
+bool loadWorld(const char* path, WorldSnapshot& world, bool endless)
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "rb");
+    if (file == nullptr) {
+        SDL_Log("Unable to open %s: %s", path, SDL_GetError());
+        return false;
+    }
+    char magic[4];
+    Uint32 header[2];
+    bool ok = SDL_RWread(file, magic, sizeof(magic), 1) == 1 &&
+              memcmp(magic, SAVE_MAGIC, sizeof(magic)) == 0 &&
+              SDL_RWread(file, header, sizeof(header), 1) == 1 &&
+              header[0] == SAVE_VERSION && header[1] == sizeof(WorldSnapshot) &&
+              SDL_RWread(file, &world, sizeof(WorldSnapshot), 1) == 1 &&
+              isValidWorld(world, endless);
+    SDL_RWclose(file);
+    if (!ok) SDL_Log("%s is not a valid save file", path);
+    return ok;
+}
+
+#endif
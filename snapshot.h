@@ -0,0 +1,132 @@
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+#include <SDL.h>
+#include "defs.h"
+#include "chunks.h"
+
+const int MAX_SNAPSHOT_OBSTACLES = 32;
+
+// Running totals of things worth a visual effect. The render thread may skip
+// snapshots, so it compares totals instead of waiting for one-shot flags.
+struct EffectEvents {
+    Uint32 landings = 0;
+    Uint32 hits = 0;
+    Uint32 carrots = 0;
+    float landingX = 0.0f, landingY = 0.0f;
+    float hitX = 0.0f, hitY = 0.0f;
+    float carrotX = 0.0f, carrotY = 0.0f;
+};
+
+struct ObstacleView {
+    SDL_Texture* texture;
+    int x, y;
+    int width, height;
+};
+
+// Everything the render thread needs to draw one frame. Written only by the
+// simulation thread, then handed over whole through the TripleBuffer below.
+struct FrameSnapshot {
+    Uint32 tick = 0;
+    float rabbitY = 0.0f;
+    int rabbitFrame = 0;
+    int redBirdFrame = 0;
+    int backgroundOffset = 0;
+
+    int obstacleCount = 0;
+    ObstacleView obstacles[MAX_SNAPSHOT_OBSTACLES];
+
+    bool carrotAppeared = false;
+    float carrotX = 0.0f;
+
+    EffectEvents effects;
+
+    bool gameOver = false;
+    bool gameWin = false;
+};
+
+struct WorldObstacle {
+    Sint32 kind;
+    Sint32 x, y;
+    Sint32 passed;
+};
+
+// The complete simulation state, for rewinding and for save files. Plain
+// fixed-size fields only, all four bytes wide so the layout has no padding
+// and can be diffed and written to disk as raw bytes.
+struct WorldSnapshot {
+    Uint32 tick;
+    float rabbitY;
+    float previousRabbitY;
+    float velocityY;
+    Sint32 isJumping;
+    Sint32 gameOver;
+    Sint32 gameWin;
+
+    Sint32 obstaclesCleared;
+    Sint32 carrotAppeared;
+    float carrotX;
+
+    Uint32 randomState;
+    Sint32 spawnElapsed;
+    Sint32 speed;
+    Sint32 nextChunkX;
+    Sint32 speedMarkCount;
+    Sint32 speedMarks[MAX_SPEED_MARKS][2];
+
+    // Endless mode only: chunk n is a pure function of (chunkSeed, n), so the
+    // generator can be put back to where this world left off.
+    Sint32 endless;
+    Uint32 chunkSeed;
+    Sint32 nextChunkIndex;
+
+    Sint32 rabbitFrame;
+    Sint32 redBirdFrame;
+    Sint32 rabbitTickCounter;
+    Sint32 redBirdTickCounter;
+    Sint32 backgroundOffset;
+
+    Sint32 obstacleCount;
+    WorldObstacle obstacles[MAX_SNAPSHOT_OBSTACLES];
+};
+
+// Lock-free single producer / single consumer triple buffer.
+// The writer always owns one slot, the reader owns another and the third sits
+// in the middle. Publishing swaps the writer slot with the middle one, reading
+// swaps the middle slot with the reader's only when something new was published,
+// so neither side ever waits on the other.
+struct TripleBuffer {
+    static const int INDEX_MASK = 0x3;
+    static const int FRESH_BIT = 0x4;
+
+    FrameSnapshot slots[3];
+    SDL_atomic_t middle;
+    int back = 0;
+    int front = 1;
+
+    void init()
+    {
+        back = 0;
+        front = 1;
+        SDL_AtomicSet(&middle, 2);
+    }
+
+    FrameSnapshot& writeSlot()
+    {
+        return slots[back];
+    }
+
+    void publish()
+    {
+        back = SDL_AtomicSet(&middle, back | FRESH_BIT) & INDEX_MASK;
+    }
+
+    const FrameSnapshot& latest()
+    {
+        if (SDL_AtomicGet(&middle) & FRESH_BIT) {
+            front = SDL_AtomicSet(&middle, front) & INDEX_MASK;
+        }
+        return slots[front];
+    }
+};
+
+#endif